@@ -0,0 +1,71 @@
+#include "kernel.h"
+
+// Slab allocator for fixed-size kernel objects, backed by the frame
+// allocator. Each cache carves whole frames into objects and threads
+// the free ones through an intrusive list, so allocation and free are
+// O(1) pointer pops and memory grows with actual load instead of
+// being reserved at the worst case up front.
+
+// Initialize a cache for objects of the given size
+void slab_cache_init(slab_cache_t *cache, const char *name, size_t object_size) {
+    // The free-list link lives in the first word of a free object
+    if (object_size < sizeof(void*)) {
+        object_size = sizeof(void*);
+    }
+
+    cache->name = name;
+    cache->object_size = (object_size + 15) & ~(size_t)15; // 16-byte aligned
+    cache->free_list = NULL;
+    cache->total_objects = 0;
+    cache->free_objects = 0;
+    cache->lock = 0;
+}
+
+// Carve one more slab out of fresh frames (lock must be held)
+void slab_cache_grow(slab_cache_t *cache) {
+    // Page-sized and larger objects get whole frames to themselves,
+    // which also makes them page-aligned
+    int pages = 1;
+    int per_slab = PAGE_SIZE / cache->object_size;
+    if (per_slab == 0) {
+        pages = (cache->object_size + PAGE_SIZE - 1) / PAGE_SIZE;
+        per_slab = 1;
+    }
+
+    uint8_t *slab = (uint8_t*)alloc_frames(pages);
+    for (int i = 0; i < per_slab; i++) {
+        void *obj = slab + i * cache->object_size;
+        *(void**)obj = cache->free_list;
+        cache->free_list = obj;
+    }
+
+    cache->total_objects += per_slab;
+    cache->free_objects += per_slab;
+}
+
+// Allocate one object: pop the free list, growing the cache if empty
+void *slab_alloc(slab_cache_t *cache) {
+    spin_lock(&cache->lock);
+
+    if (!cache->free_list) {
+        slab_cache_grow(cache);
+    }
+
+    void *obj = cache->free_list;
+    cache->free_list = *(void**)obj;
+    cache->free_objects--;
+
+    spin_unlock(&cache->lock);
+    return obj;
+}
+
+// Return one object to its cache
+void slab_free(slab_cache_t *cache, void *obj) {
+    spin_lock(&cache->lock);
+
+    *(void**)obj = cache->free_list;
+    cache->free_list = obj;
+    cache->free_objects++;
+
+    spin_unlock(&cache->lock);
+}
@@ -16,26 +16,98 @@ typedef unsigned long size_t;
 typedef int bool;
 #define true 1
 #define false 0
+#define NULL ((void*)0)
 
 // Kernel configuration
-#define MAX_TASKS 8
+#define MAX_TASKS 256
+#define MAX_PRIORITIES 8
+#define MAX_CPUS 8
+
+// Spinlock for data shared between CPUs
+typedef volatile int spinlock_t;
 #define MAX_IPC_MESSAGES 32
 #define MAX_MESSAGE_SIZE 256
 #define PAGE_SIZE 4096
+#define CACHE_LINE_SIZE 64
+#define HUGE_PAGE_SIZE 0x200000
 #define KERNEL_STACK_SIZE 8192
 #define USER_STACK_SIZE 16384
 
 // Memory layout
 #define KERNEL_BASE 0x100000
 #define KERNEL_STACK_TOP 0x200000
+#define INITRD_BASE 0x300000
 #define USER_BASE 0x400000
 #define USER_STACK_TOP 0x600000
 
+// Model-specific registers for SYSCALL/SYSRET
+#define MSR_EFER 0xC0000080
+#define MSR_STAR 0xC0000081
+#define MSR_LSTAR 0xC0000082
+#define MSR_SFMASK 0xC0000084
+#define MSR_GS_BASE 0xC0000101
+#define MSR_KERNEL_GS_BASE 0xC0000102
+
 // System call numbers
 #define SYS_SEND 1
 #define SYS_RECV 2
 #define SYS_YIELD 3
 #define SYS_EXIT 4
+#define SYS_SEND_GRANT 5
+#define SYS_RECV_GRANT 6
+#define SYS_SEND_BATCH 7
+#define SYS_RECV_BATCH 8
+#define SYS_SLEEP 9
+#define SYS_RECV_NB 10
+#define SYS_WAIT_ANY 11
+#define SYS_GET_STATS 12
+#define SYS_SENDV 13
+#define SYS_RECVV 14
+#define SYS_TASK_STATS 15
+#define SYS_FORK 16
+
+// Instrumented kernel paths
+#define STAT_PATH_SYSCALL 0
+#define STAT_PATH_SCHEDULE 1
+#define STAT_PATH_SEND 2
+#define STAT_PATH_RECV 3
+#define STAT_PATH_PAGE_FAULT 4
+#define STAT_PATH_COUNT 5
+#define STAT_HISTOGRAM_BUCKETS 32
+
+// Initrd archive format (build/initrd.img, produced by tools/mkinitrd):
+// a header, a member table, then the member data. Each member's bytes
+// start on a page boundary within the image so read-only ELF segments
+// can be mapped straight from the initrd's frames without copying.
+#define INITRD_MAGIC 0x64726E69 // "inrd"
+#define INITRD_MAX_MEMBERS 16
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count; // Members in the table that follows
+} initrd_header_t;
+
+typedef struct {
+    char name[32];
+    uint64_t offset; // From the start of the image, page aligned
+    uint64_t size;   // Exact member size in bytes
+} initrd_member_t;
+
+// IPC error codes
+#define IPC_EWOULDBLOCK -2
+
+// Timer configuration
+#define PIT_FREQUENCY 1193180
+#define QUANTUM_MS 10
+
+// IPC page grants
+#define MAX_IPC_GRANTS 8
+#define MAX_GRANT_PAGES 16
+
+// Adaptive spin-then-block receive: bounds on the per-task spin
+// window, in TSC cycles (kernel/ipc.c)
+#define RECV_SPIN_MIN 256
+#define RECV_SPIN_MAX 65536
 
 // Task states
 typedef enum {
@@ -45,19 +117,59 @@ typedef enum {
     TASK_ZOMBIE
 } task_state_t;
 
-// Task control block
-typedef struct {
+// What a blocked task is waiting on
+#define WAIT_NONE 0
+#define WAIT_IPC 1
+#define WAIT_SLEEP 2
+
+// Per-task IPC state, allocated on first use (kernel/ipc.c)
+struct ipc_queue;
+
+// Task control block, cache-line aligned so the hot context-switch
+// block at the top shares one line and never straddles into (or false
+// shares with) a neighbouring task's state. Fields are ordered hottest
+// first: the switch block, then scheduler/wait bookkeeping touched on
+// the block/wake paths, then cold identity data read almost never.
+typedef struct pcb {
+    // Hot: loaded and stored by the switch and syscall stubs on every
+    // crossing. Offsets are baked into kernel/context.S — do not
+    // reorder.
     uint64_t rsp;          // Stack pointer
     uint64_t rip;          // Instruction pointer
     uint64_t rflags;       // Flags register
     uint64_t cr3;          // Page table base
+    uint64_t user_rsp;     // User stack across a syscall (syscall_entry)
+
+    // Warm: scheduling, waiting and IPC bookkeeping
     task_state_t state;    // Current state
     int pid;               // Process ID
-    int priority;          // Priority level
+    int priority;          // Priority level (may be inherited)
+    int base_priority;     // Own priority before any inheritance
+    int wait_state;        // WAIT_* reason while TASK_BLOCKED
+    struct pcb *wait_next; // Intrusive wait-queue / timer-wheel link
+    uint64_t wakeup_ms;    // Timer-wheel deadline (0 = not on the wheel)
+    int ipc_partner;       // PID we await an RPC reply from (-1 = none)
+    uint64_t runtime_cycles; // Total CPU time consumed (TSC cycles)
+    uint64_t recv_spin_cycles; // Spin window before a blocking recv (0 = block at once)
+    struct ipc_queue *ipc_queue; // Message/grant queues, lazily allocated
+
+    // Cold: identity and rarely-touched state
     uint64_t stack_base;   // Stack base address
     uint64_t stack_size;   // Stack size
     char name[32];         // Task name
-} pcb_t;
+    int fpu_used;          // Task has touched FPU/SSE state
+    uint8_t fpu_state[512] __attribute__((aligned(16))); // FXSAVE area
+} __attribute__((aligned(CACHE_LINE_SIZE))) pcb_t;
+
+// Slab cache for fixed-size kernel objects (kernel/alloc.c)
+typedef struct slab_cache {
+    const char *name;   // For diagnostics
+    size_t object_size; // Rounded up; the free-list link lives in the object
+    void *free_list;    // Intrusive list of free objects
+    int total_objects;  // Objects ever carved for this cache
+    int free_objects;   // Currently on the free list
+    spinlock_t lock;
+} slab_cache_t;
 
 // IPC message structure
 typedef struct {
@@ -67,6 +179,45 @@ typedef struct {
     char data[MAX_MESSAGE_SIZE];
 } ipc_message_t;
 
+// Scatter-gather element for vectored IPC
+typedef struct {
+    void *base;  // Start of this fragment
+    size_t len;  // Bytes in this fragment
+} ipc_iovec_t;
+
+// Message descriptor for batched IPC
+typedef struct {
+    int pid;     // Target PID (send) / filled with sender PID (recv)
+    void *data;
+    size_t size; // Bytes to send / buffer size, set to bytes received
+} ipc_msg_desc_t;
+
+// Kernel latency statistics: per-path rdtsc histograms with
+// power-of-two buckets, plus counts and totals for averages
+typedef struct {
+    uint64_t count[STAT_PATH_COUNT];
+    uint64_t total_cycles[STAT_PATH_COUNT];
+    uint64_t histogram[STAT_PATH_COUNT][STAT_HISTOGRAM_BUCKETS];
+} kernel_stats_t;
+
+// Per-task execution statistics (sys_task_stats)
+typedef struct {
+    int pid;
+    int state;               // task_state_t value
+    int priority;
+    uint64_t runtime_cycles; // CPU time consumed so far
+    char name[32];
+} task_stats_t;
+
+// IPC page grant (zero-copy message)
+typedef struct {
+    int sender_pid;
+    int receiver_pid;
+    size_t size;
+    int page_count;
+    uint64_t pages[MAX_GRANT_PAGES]; // Physical addresses of granted pages
+} ipc_grant_t;
+
 // Page table entry
 typedef struct {
     uint64_t present : 1;
@@ -108,7 +259,7 @@ typedef struct {
 // Function declarations
 
 // Kernel main
-void kernel_main(void);
+void kernel_main(uint64_t initrd_addr);
 
 // GDT functions
 void gdt_init(void);
@@ -121,6 +272,8 @@ void idt_set_entry(int index, uint64_t handler, uint16_t selector, uint8_t flags
 // Paging functions
 void paging_init(void);
 void map_page(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool writable);
+void map_page_noflush(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool writable);
+void map_page_2mb(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool writable);
 void unmap_page(uint64_t virtual_addr);
 uint64_t get_physical_address(uint64_t virtual_addr);
 
@@ -129,29 +282,99 @@ void scheduler_init(void);
 void schedule(void);
 void switch_to(pcb_t *task);
 void yield(void);
+void fpu_init(void);
+void fpu_trap_handler_c(void);
+void pid_hash_init(void);
+pcb_t *get_task_by_pid(int pid);
+void inherit_priority(pcb_t *task, int priority);
+void restore_priority(pcb_t *task);
+void account_runtime(void);
 int create_task(const char *name, uint64_t entry_point, int priority);
+int create_kernel_task(const char *name, void (*entry)(void), int priority);
+int fork_task(void);
 void exit_task(int exit_code);
 
 // IPC functions
 int sys_send(int pid, void *msg, size_t len);
-int sys_recv(void *buf, size_t len);
+int sys_recv(void *buf, size_t len, uint64_t timeout_ms);
+int sys_send_grant(int pid, void *addr, size_t len);
+int sys_recv_grant(void *addr, size_t len);
+int sys_send_batch(ipc_msg_desc_t *descs, int count);
+int sys_recv_batch(ipc_msg_desc_t *descs, int count);
+int sys_sendv(int pid, ipc_iovec_t *iov, int iovcnt);
+int sys_recvv(ipc_iovec_t *iov, int iovcnt);
+int sys_recv_nb(void *buf, size_t len);
+int sys_wait_any(int *sender_pids, int count);
 void ipc_init(void);
+void ipc_queue_destroy(pcb_t *task);
 
 // Virtual memory functions
 void vm_init(void);
 void page_fault_handler(void);
 int allocate_page(uint64_t addr);
 void evict_lru_page(void);
+uint64_t alloc_frame(void);
+uint64_t alloc_frames(int count);
+uint64_t alloc_frame_2mb(void);
+void free_frame(uint64_t physical_addr);
+int register_elf_region(int pid, uint64_t vaddr, uint64_t memsz, const uint8_t *file_data, uint64_t filesz);
+void clear_elf_regions(int pid);
+int handle_elf_fault(uint64_t fault_addr);
+uint64_t create_address_space(void);
+uint64_t clone_address_space(uint64_t parent_cr3);
+void mark_cow_range(uint64_t parent_cr3, uint64_t child_cr3);
+int handle_cow_fault(uint64_t fault_addr);
+
+// Initrd and program loading (loader/loader.c)
+void initrd_init(uint64_t addr);
+const uint8_t *initrd_find(const char *name, size_t *size);
+int load_elf(const char *path, pcb_t *task);
+int load_elf_from_memory(const uint8_t *data, uint64_t base_addr, int pid);
+int load_user_program(const char *name, uint64_t stack_top);
+
+// SMP functions
+void smp_init(int num_cpus);
+int smp_apic_id(void);
+int smp_cpu_id(void);
+uint64_t smp_kernel_stack_top(int cpu);
+void ap_main(void);
 
 // Timer functions
 void timer_init(void);
 void timer_handler(void);
+void timer_arm_oneshot(uint32_t pit_cycles);
+void program_next_deadline(void);
+void timer_wheel_insert(pcb_t *task, uint64_t wakeup_ms);
+void timer_wheel_remove(pcb_t *task);
+int sys_sleep(uint64_t ms);
 
-// System call handler
+// System call handlers
 void syscall_handler(void);
+void syscall_init(void);
+
+// Instrumentation functions
+void stats_init(void);
+void stats_record(int path, uint64_t start_tsc);
+void stats_record_cycles(int path, uint64_t cycles);
+int sys_get_stats(kernel_stats_t *buf);
+int sys_task_stats(task_stats_t *buf, int max_tasks);
+void stats_dump(void);
+
+// Slab allocator (kernel/alloc.c)
+void slab_cache_init(slab_cache_t *cache, const char *name, size_t object_size);
+void *slab_alloc(slab_cache_t *cache);
+void slab_free(slab_cache_t *cache, void *obj);
+
+// Memory primitives (kernel/string.c)
+void *kmemcpy(void *dst, const void *src, size_t n);
+void *kmemset(void *dst, int value, size_t n);
+void kzero_nt(void *dst, size_t n);
+size_t kstrncpy(char *dst, const char *src, size_t n);
 
 // Utility functions
 void kprintf(const char *format, ...);
+void klog_flush(void);
+void klog_flusher_task(void);
 void panic(const char *message);
 void halt(void);
 
@@ -159,13 +382,36 @@ void halt(void);
 extern void switch_to_asm(pcb_t *task);
 extern void enable_interrupts(void);
 extern void disable_interrupts(void);
+extern uint64_t read_cr0(void);
+extern void write_cr0(uint64_t value);
 extern uint64_t read_cr2(void);
 extern uint64_t read_cr3(void);
 extern void write_cr3(uint64_t value);
+extern uint64_t read_cr4(void);
+extern void write_cr4(uint64_t value);
+extern void fpu_trap_handler(void);
+extern void invlpg_page(uint64_t virtual_addr);
+extern void spin_lock(spinlock_t *lock);
+extern void spin_unlock(spinlock_t *lock);
+extern uint64_t read_tsc(void);
+extern uint64_t read_msr(uint64_t msr);
+extern void write_msr(uint64_t msr, uint64_t value);
+extern void syscall_entry(void);
+
+// AP trampoline markers (kernel/context.S)
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_stack_ptr[];
+extern uint8_t ap_entry_ptr[];
 
 // Global variables
-extern pcb_t *current_task;
+extern pcb_t *current_tasks[MAX_CPUS];
 extern pcb_t tasks[MAX_TASKS];
 extern int next_pid;
+extern int cpu_count;
+extern uint64_t system_time_ms;
+
+// The calling CPU's current task
+#define current_task (current_tasks[smp_cpu_id()])
 
 #endif // KERNEL_H 
\ No newline at end of file
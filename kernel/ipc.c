@@ -1,89 +1,567 @@
 #include "kernel.h"
 
-// IPC message queues per task
-ipc_message_t message_queues[MAX_TASKS][MAX_IPC_MESSAGES];
-int queue_head[MAX_TASKS];
-int queue_tail[MAX_TASKS];
-int queue_count[MAX_TASKS];
+// Coarse lock protecting the shared message and grant queues on SMP
+spinlock_t ipc_lock = 0;
 
-// Blocked tasks waiting for messages
-pcb_t *blocked_tasks[MAX_TASKS];
-int blocked_count = 0;
+// Slab-allocated message node: the queue is a linked list of these,
+// so a burst can grow past the old fixed ring instead of dropping at
+// MAX_IPC_MESSAGES, and idle tasks hold no message memory at all.
+typedef struct ipc_msg_node {
+    ipc_message_t msg;
+    struct ipc_msg_node *next;
+} ipc_msg_node_t;
+
+slab_cache_t ipc_message_cache;
+slab_cache_t ipc_queue_cache;
+
+// Per-task IPC state, allocated on first use so memory scales with
+// the tasks that actually exchange messages rather than with the cap.
+// Cache-line aligned (the slab hands out multiples of the struct size
+// from page-aligned slabs) so two tasks' queue counters never share a
+// line.
+struct ipc_queue {
+    // Queued messages, oldest first
+    ipc_msg_node_t *msg_head;
+    ipc_msg_node_t *msg_tail;
+    int count;
+    int last_sender_pid; // Sender of the most recently dequeued message
+
+    // Pending page grants (zero-copy IPC)
+    ipc_grant_t grants[MAX_IPC_GRANTS];
+    int grant_head;
+    int grant_tail;
+    int grant_count;
+
+    // Direct-handoff state: where a blocked receiver wants its message,
+    // and how a direct delivery reports its size back to sys_recv
+    void *recv_buffer;
+    size_t recv_length;
+    int direct_size; // -1 = no direct delivery pending
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// Get a task's IPC queue, allocating and initializing it on first use
+struct ipc_queue *ipc_queue_get(pcb_t *task) {
+    if (!task->ipc_queue) {
+        struct ipc_queue *q = (struct ipc_queue*)slab_alloc(&ipc_queue_cache);
+        q->msg_head = NULL;
+        q->msg_tail = NULL;
+        q->count = 0;
+        q->last_sender_pid = -1;
+        q->grant_head = 0;
+        q->grant_tail = 0;
+        q->grant_count = 0;
+        q->recv_buffer = NULL;
+        q->recv_length = 0;
+        q->direct_size = -1;
+        task->ipc_queue = q;
+    }
+    return task->ipc_queue;
+}
 
 // Initialize IPC subsystem
 void ipc_init(void) {
-    for (int i = 0; i < MAX_TASKS; i++) {
-        queue_head[i] = 0;
-        queue_tail[i] = 0;
-        queue_count[i] = 0;
+    slab_cache_init(&ipc_message_cache, "ipc_message", sizeof(ipc_msg_node_t));
+    slab_cache_init(&ipc_queue_cache, "ipc_queue", sizeof(struct ipc_queue));
+}
+
+// Free an exiting task's IPC state: queued message nodes first, then
+// the queue itself, so memory really does scale with live tasks
+void ipc_queue_destroy(pcb_t *task) {
+    struct ipc_queue *q = task->ipc_queue;
+    if (!q) {
+        return;
+    }
+
+    spin_lock(&ipc_lock);
+    while (q->msg_head) {
+        ipc_msg_node_t *node = q->msg_head;
+        q->msg_head = node->next;
+        slab_free(&ipc_message_cache, node);
     }
-    blocked_count = 0;
+    q->msg_tail = NULL;
+    q->count = 0;
+    spin_unlock(&ipc_lock);
+
+    task->ipc_queue = NULL;
+    slab_free(&ipc_queue_cache, q);
 }
 
 // Send message to task
 int sys_send(int pid, void *msg, size_t len) {
+    uint64_t start_tsc = read_tsc();
+
     if (!current_task) {
         return -1;
     }
-    
+
     if (len > MAX_MESSAGE_SIZE) {
         return -1;
     }
-    
+
     // Find target task
     pcb_t *target = get_task_by_pid(pid);
     if (!target) {
         return -1;
     }
-    
-    // Check if target task's queue is full
-    if (queue_count[target->pid] >= MAX_IPC_MESSAGES) {
-        return -1;
+
+    // Sending is how a server replies, so any priority donated while a
+    // client waited on us ends here. Record the target as the task we
+    // would be waiting on if we block in sys_recv next (the RPC case).
+    restore_priority(current_task);
+    current_task->ipc_partner = pid;
+
+    struct ipc_queue *q = ipc_queue_get(target);
+
+    // Fast path: receiver is already blocked in sys_recv, so copy
+    // straight into its buffer and hand the CPU to it immediately,
+    // donating the rest of our timeslice. This skips the message ring
+    // and the scheduling round-trip entirely.
+    if (target->state == TASK_BLOCKED && target->wait_state == WAIT_IPC && q->recv_buffer) {
+        size_t copy_len = (q->recv_length < len) ? q->recv_length : len;
+        kmemcpy(q->recv_buffer, msg, copy_len);
+        q->direct_size = copy_len;
+        q->last_sender_pid = current_task->pid;
+        q->recv_buffer = NULL;
+        target->wait_state = WAIT_NONE;
+        timer_wheel_remove(target); // Cancel any recv timeout
+
+        stats_record(STAT_PATH_SEND, start_tsc);
+
+        // Switch to the receiver right away
+        account_runtime();
+        current_task->state = TASK_READY;
+        enqueue_ready(current_task);
+        target->state = TASK_RUNNING;
+        current_task = target;
+        switch_to_asm(target);
+
+        // Resumed after the receiver ran
+        return copy_len;
     }
-    
+
     // Create message
-    ipc_message_t *message = &message_queues[target->pid][queue_tail[target->pid]];
-    message->sender_pid = current_task->pid;
-    message->receiver_pid = pid;
-    message->size = len;
-    
+    ipc_msg_node_t *node = (ipc_msg_node_t*)slab_alloc(&ipc_message_cache);
+    if (!node) {
+        return -1;
+    }
+    node->msg.sender_pid = current_task->pid;
+    node->msg.receiver_pid = pid;
+    node->msg.size = len;
+    node->next = NULL;
+
     // Copy message data
-    for (size_t i = 0; i < len; i++) {
-        message->data[i] = ((char*)msg)[i];
-    }
-    
-    // Add to queue
-    queue_tail[target->pid] = (queue_tail[target->pid] + 1) % MAX_IPC_MESSAGES;
-    queue_count[target->pid]++;
-    
+    kmemcpy(node->msg.data, msg, len);
+
+    spin_lock(&ipc_lock);
+
+    // Append to the queue
+    if (q->msg_tail) {
+        q->msg_tail->next = node;
+    } else {
+        q->msg_head = node;
+    }
+    q->msg_tail = node;
+    q->count++;
+
+    spin_unlock(&ipc_lock);
+
+    // Unblock target task if it was waiting - one pointer check, no scan
+    if (target->state == TASK_BLOCKED && target->wait_state == WAIT_IPC) {
+        unblock_task(target);
+    }
+
+    stats_record(STAT_PATH_SEND, start_tsc);
+    return len;
+}
+
+// Receive message. A timeout_ms of 0 blocks until a message arrives;
+// otherwise the call returns -1 if nothing is delivered before the
+// deadline, using the scheduler's timer wheel for the wakeup.
+int sys_recv(void *buf, size_t len, uint64_t timeout_ms) {
+    uint64_t start_tsc = read_tsc();
+
+    if (!current_task) {
+        return -1;
+    }
+
+    struct ipc_queue *q = ipc_queue_get(current_task);
+
+    // Adaptive spin-then-block: a reply that lands a microsecond after
+    // we would have blocked still costs two context switches, so poll
+    // the queue for a short bounded window first (senders on another
+    // CPU enqueue without needing us to block). The window adapts per
+    // task — a spin that catches a message doubles it, a wasted spin
+    // halves it — so tight RPC pairs keep spinning while everyone else
+    // decays to blocking straight away.
+    if (q->count == 0 && current_task->recv_spin_cycles > 0) {
+        uint64_t spin_deadline = read_tsc() + current_task->recv_spin_cycles;
+        volatile int *count = &q->count; // Another CPU writes it under us
+        while (*count == 0 && read_tsc() < spin_deadline) {
+            __asm__ volatile("pause");
+        }
+
+        if (q->count > 0) {
+            if (current_task->recv_spin_cycles < RECV_SPIN_MAX) {
+                current_task->recv_spin_cycles *= 2;
+            }
+        } else if (current_task->recv_spin_cycles > RECV_SPIN_MIN) {
+            current_task->recv_spin_cycles /= 2;
+        }
+    }
+
+    // Check if we have messages
+    if (q->count == 0) {
+        // Publish our buffer so a sender can deliver directly into it
+        q->recv_buffer = buf;
+        q->recv_length = len;
+
+        // Block current task, with a timer-wheel deadline if requested
+        current_task->state = TASK_BLOCKED;
+        current_task->wait_state = WAIT_IPC;
+
+        // Priority inheritance: if we are waiting on a reply from a
+        // lower-priority server, let it run at our priority so
+        // medium-priority tasks cannot starve it under us
+        if (current_task->ipc_partner >= 0) {
+            pcb_t *server = get_task_by_pid(current_task->ipc_partner);
+            if (server) {
+                inherit_priority(server, current_task->priority);
+            }
+        }
+
+        if (timeout_ms > 0) {
+            timer_wheel_insert(current_task, system_time_ms + timeout_ms);
+            program_next_deadline();
+        }
+
+        // Switch to another task
+        pcb_t *next_task = dequeue_ready();
+        if (next_task) {
+            current_task = next_task;
+            current_task->state = TASK_RUNNING;
+            switch_to_asm(current_task);
+        } else {
+            // No other tasks, halt
+            while (1) {
+                __asm__("hlt");
+            }
+        }
+
+        // Exclude the blocked time from the recv-path measurement
+        start_tsc = read_tsc();
+
+        // The wait is over, whatever woke us
+        current_task->ipc_partner = -1;
+
+        // Resumed: a direct handoff may have filled our buffer already
+        if (q->direct_size >= 0) {
+            int size = q->direct_size;
+            q->direct_size = -1;
+            stats_record(STAT_PATH_RECV, start_tsc);
+            return size;
+        }
+        q->recv_buffer = NULL;
+
+        // Woken by the timer wheel with nothing delivered: timed out
+        if (q->count == 0) {
+            stats_record(STAT_PATH_RECV, start_tsc);
+            return -1;
+        }
+    }
+
+    spin_lock(&ipc_lock);
+
+    // Unlink the oldest message
+    ipc_msg_node_t *node = q->msg_head;
+    q->msg_head = node->next;
+    if (!q->msg_head) {
+        q->msg_tail = NULL;
+    }
+    q->count--;
+    q->last_sender_pid = node->msg.sender_pid;
+
+    spin_unlock(&ipc_lock);
+
+    // Copy message data and recycle the node
+    size_t copy_len = (len < node->msg.size) ? len : node->msg.size;
+    kmemcpy(buf, node->msg.data, copy_len);
+    slab_free(&ipc_message_cache, node);
+
+    stats_record(STAT_PATH_RECV, start_tsc);
+    return copy_len;
+}
+
+// Vectored send: gather from multiple user buffers straight into the
+// message (or the blocked receiver's buffer), so callers never need a
+// staging copy to glue header and payload together.
+int sys_sendv(int pid, ipc_iovec_t *iov, int iovcnt) {
+    uint64_t start_tsc = read_tsc();
+
+    if (!current_task || !iov || iovcnt <= 0) {
+        return -1;
+    }
+
+    // Total payload must fit one message. Bound each fragment before
+    // summing: the lengths are user-controlled, and letting the sum
+    // wrap would slip an oversized copy past the check below.
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].len > MAX_MESSAGE_SIZE) {
+            return -1;
+        }
+        total += iov[i].len;
+        if (total > MAX_MESSAGE_SIZE) {
+            return -1;
+        }
+    }
+
+    // Find target task
+    pcb_t *target = get_task_by_pid(pid);
+    if (!target) {
+        return -1;
+    }
+
+    // Same reply/RPC bookkeeping as sys_send
+    restore_priority(current_task);
+    current_task->ipc_partner = pid;
+
+    struct ipc_queue *q = ipc_queue_get(target);
+
+    // Fast path: gather directly into the blocked receiver's buffer
+    if (target->state == TASK_BLOCKED && target->wait_state == WAIT_IPC && q->recv_buffer) {
+        size_t room = q->recv_length;
+        char *dst = (char*)q->recv_buffer;
+        size_t copied = 0;
+        for (int i = 0; i < iovcnt && copied < room; i++) {
+            size_t chunk = iov[i].len;
+            if (copied + chunk > room) {
+                chunk = room - copied;
+            }
+            kmemcpy(dst + copied, iov[i].base, chunk);
+            copied += chunk;
+        }
+        q->direct_size = copied;
+        q->last_sender_pid = current_task->pid;
+        q->recv_buffer = NULL;
+        target->wait_state = WAIT_NONE;
+        timer_wheel_remove(target); // Cancel any recv timeout
+
+        stats_record(STAT_PATH_SEND, start_tsc);
+
+        // Switch to the receiver right away
+        account_runtime();
+        current_task->state = TASK_READY;
+        enqueue_ready(current_task);
+        target->state = TASK_RUNNING;
+        current_task = target;
+        switch_to_asm(target);
+
+        // Resumed after the receiver ran
+        return copied;
+    }
+
+    // Gather the fragments into one message
+    ipc_msg_node_t *node = (ipc_msg_node_t*)slab_alloc(&ipc_message_cache);
+    if (!node) {
+        return -1;
+    }
+    node->msg.sender_pid = current_task->pid;
+    node->msg.receiver_pid = pid;
+    node->msg.size = total;
+    node->next = NULL;
+
+    size_t offset = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        kmemcpy(node->msg.data + offset, iov[i].base, iov[i].len);
+        offset += iov[i].len;
+    }
+
+    spin_lock(&ipc_lock);
+
+    // Append to the queue
+    if (q->msg_tail) {
+        q->msg_tail->next = node;
+    } else {
+        q->msg_head = node;
+    }
+    q->msg_tail = node;
+    q->count++;
+
+    spin_unlock(&ipc_lock);
+
     // Unblock target task if it was waiting
-    for (int i = 0; i < blocked_count; i++) {
-        if (blocked_tasks[i] && blocked_tasks[i]->pid == pid) {
-            unblock_task(blocked_tasks[i]);
-            // Remove from blocked list
-            for (int j = i; j < blocked_count - 1; j++) {
-                blocked_tasks[j] = blocked_tasks[j + 1];
+    if (target->state == TASK_BLOCKED && target->wait_state == WAIT_IPC) {
+        unblock_task(target);
+    }
+
+    stats_record(STAT_PATH_SEND, start_tsc);
+    return total;
+}
+
+// Vectored receive: scatter one message across multiple user buffers
+// in a single pass. A vectored receiver has no single buffer to
+// publish for direct handoff, so an empty queue blocks the plain way
+// and the message is scattered after wakeup.
+int sys_recvv(ipc_iovec_t *iov, int iovcnt) {
+    uint64_t start_tsc = read_tsc();
+
+    if (!current_task || !iov || iovcnt <= 0) {
+        return -1;
+    }
+
+    struct ipc_queue *q = ipc_queue_get(current_task);
+
+    // Block until a message is queued
+    while (q->count == 0) {
+        current_task->state = TASK_BLOCKED;
+        current_task->wait_state = WAIT_IPC;
+
+        // Donate our priority to the server we are waiting on, as in
+        // sys_recv
+        if (current_task->ipc_partner >= 0) {
+            pcb_t *server = get_task_by_pid(current_task->ipc_partner);
+            if (server) {
+                inherit_priority(server, current_task->priority);
             }
-            blocked_count--;
-            break;
         }
+
+        pcb_t *next_task = dequeue_ready();
+        if (next_task) {
+            current_task = next_task;
+            current_task->state = TASK_RUNNING;
+            switch_to_asm(current_task);
+        } else {
+            // No other tasks, halt
+            while (1) {
+                __asm__("hlt");
+            }
+        }
+
+        // Exclude the blocked time from the recv-path measurement
+        start_tsc = read_tsc();
+        current_task->ipc_partner = -1;
+    }
+
+    spin_lock(&ipc_lock);
+
+    // Unlink the oldest message
+    ipc_msg_node_t *node = q->msg_head;
+    q->msg_head = node->next;
+    if (!q->msg_head) {
+        q->msg_tail = NULL;
+    }
+    q->count--;
+    q->last_sender_pid = node->msg.sender_pid;
+
+    spin_unlock(&ipc_lock);
+
+    // Scatter across the fragments and recycle the node
+    size_t remaining = node->msg.size;
+    size_t offset = 0;
+    for (int i = 0; i < iovcnt && remaining > 0; i++) {
+        size_t chunk = (iov[i].len < remaining) ? iov[i].len : remaining;
+        kmemcpy(iov[i].base, node->msg.data + offset, chunk);
+        offset += chunk;
+        remaining -= chunk;
+    }
+    slab_free(&ipc_message_cache, node);
+
+    stats_record(STAT_PATH_RECV, start_tsc);
+    return offset;
+}
+
+// Send message pages by granting them to the target (zero-copy)
+// The sender's pages are unmapped and ownership moves to the receiver,
+// so multi-kilobyte payloads avoid the double copy through the ring.
+int sys_send_grant(int pid, void *addr, size_t len) {
+    if (!current_task) {
+        return -1;
     }
-    
+
+    // Grants work on whole pages, so the buffer must be page-aligned
+    if (((uint64_t)addr & (PAGE_SIZE - 1)) != 0 || len == 0) {
+        return -1;
+    }
+
+    int page_count = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (page_count > MAX_GRANT_PAGES) {
+        return -1;
+    }
+
+    // Find target task
+    pcb_t *target = get_task_by_pid(pid);
+    if (!target) {
+        return -1;
+    }
+
+    struct ipc_queue *q = ipc_queue_get(target);
+
+    spin_lock(&ipc_lock);
+
+    // Check if target task's grant queue is full
+    if (q->grant_count >= MAX_IPC_GRANTS) {
+        spin_unlock(&ipc_lock);
+        return -1;
+    }
+
+    // Create grant
+    ipc_grant_t *grant = &q->grants[q->grant_tail];
+    grant->sender_pid = current_task->pid;
+    grant->receiver_pid = pid;
+    grant->size = len;
+    grant->page_count = page_count;
+
+    // Collect the physical pages backing the buffer
+    for (int i = 0; i < page_count; i++) {
+        uint64_t virtual_addr = (uint64_t)addr + i * PAGE_SIZE;
+        uint64_t physical_addr = get_physical_address(virtual_addr);
+        if (physical_addr == 0) {
+            spin_unlock(&ipc_lock);
+            return -1; // Buffer not fully mapped
+        }
+        grant->pages[i] = physical_addr;
+    }
+
+    // Revoke the sender's mappings - ownership moves to the receiver
+    for (int i = 0; i < page_count; i++) {
+        unmap_page((uint64_t)addr + i * PAGE_SIZE);
+    }
+
+    // Add to grant queue
+    q->grant_tail = (q->grant_tail + 1) % MAX_IPC_GRANTS;
+    q->grant_count++;
+
+    spin_unlock(&ipc_lock);
+
+    // Unblock target task if it was waiting - one pointer check, no scan
+    if (target->state == TASK_BLOCKED && target->wait_state == WAIT_IPC) {
+        unblock_task(target);
+    }
+
     return len;
 }
 
-// Receive message
-int sys_recv(void *buf, size_t len) {
+// Receive granted pages by mapping them at the given address (zero-copy)
+int sys_recv_grant(void *addr, size_t len) {
     if (!current_task) {
         return -1;
     }
-    
-    // Check if we have messages
-    if (queue_count[current_task->pid] == 0) {
+
+    // The receive window must be page-aligned
+    if (((uint64_t)addr & (PAGE_SIZE - 1)) != 0) {
+        return -1;
+    }
+
+    struct ipc_queue *q = ipc_queue_get(current_task);
+
+    // Block until a grant is pending. Re-check after every wakeup: a
+    // plain message or a timer expiry can wake us too, and dequeuing
+    // an empty grant ring would map garbage frames into the caller.
+    while (q->grant_count == 0) {
         // Block current task
         current_task->state = TASK_BLOCKED;
-        blocked_tasks[blocked_count++] = current_task;
-        
+        current_task->wait_state = WAIT_IPC;
+
         // Switch to another task
         pcb_t *next_task = dequeue_ready();
         if (next_task) {
@@ -97,33 +575,168 @@ int sys_recv(void *buf, size_t len) {
             }
         }
     }
-    
-    // Get message from queue
-    ipc_message_t *message = &message_queues[current_task->pid][queue_head[current_task->pid]];
-    
-    // Copy message data
-    size_t copy_len = (len < message->size) ? len : message->size;
-    for (size_t i = 0; i < copy_len; i++) {
-        ((char*)buf)[i] = message->data[i];
+
+    spin_lock(&ipc_lock);
+
+    // Get grant from queue
+    ipc_grant_t *grant = &q->grants[q->grant_head];
+
+    // The receive window must be large enough for the whole grant
+    if (grant->size > len) {
+        spin_unlock(&ipc_lock);
+        return -1;
+    }
+
+    // Map the granted pages into the receiver's address space
+    for (int i = 0; i < grant->page_count; i++) {
+        map_page((uint64_t)addr + i * PAGE_SIZE, grant->pages[i], true, true);
     }
-    
+
+    // Copy the size out before releasing the slot: once grant_head
+    // advances and the lock drops, a concurrent sys_send_grant can
+    // overwrite this ring entry
+    size_t size = grant->size;
+
     // Remove from queue
-    queue_head[current_task->pid] = (queue_head[current_task->pid] + 1) % MAX_IPC_MESSAGES;
-    queue_count[current_task->pid]--;
-    
-    return copy_len;
+    q->grant_head = (q->grant_head + 1) % MAX_IPC_GRANTS;
+    q->grant_count--;
+
+    spin_unlock(&ipc_lock);
+
+    return size;
+}
+
+// Non-blocking receive: returns IPC_EWOULDBLOCK instead of blocking
+// when the queue is empty, so event-loop tasks can poll cheaply.
+int sys_recv_nb(void *buf, size_t len) {
+    if (!current_task) {
+        return -1;
+    }
+
+    if (ipc_queue_get(current_task)->count == 0) {
+        return IPC_EWOULDBLOCK;
+    }
+
+    // Queue is non-empty, so sys_recv cannot block
+    return sys_recv(buf, len, 0);
+}
+
+// Block until a message from any of the given senders is queued and
+// return that sender's PID without consuming the message. A count of
+// zero waits for a message from anyone. This lets one event-loop task
+// multiplex all its peers instead of burning a task slot per peer.
+int sys_wait_any(int *sender_pids, int count) {
+    if (!current_task || count < 0) {
+        return -1;
+    }
+
+    struct ipc_queue *q = ipc_queue_get(current_task);
+
+    while (1) {
+        // Scan what is already queued for an interesting sender
+        for (ipc_msg_node_t *node = q->msg_head; node; node = node->next) {
+            int sender = node->msg.sender_pid;
+
+            if (count == 0) {
+                return sender;
+            }
+            for (int j = 0; j < count; j++) {
+                if (sender_pids[j] == sender) {
+                    return sender;
+                }
+            }
+        }
+
+        // Nothing interesting queued - block until the next send
+        current_task->state = TASK_BLOCKED;
+        current_task->wait_state = WAIT_IPC;
+
+        pcb_t *next_task = dequeue_ready();
+        if (next_task) {
+            current_task = next_task;
+            current_task->state = TASK_RUNNING;
+            switch_to_asm(current_task);
+        } else {
+            // No other tasks, halt
+            while (1) {
+                __asm__("hlt");
+            }
+        }
+    }
+}
+
+// Send a train of messages in one kernel crossing.
+// Stops at the first descriptor that cannot be delivered (bad target
+// or full queue) and returns the number actually sent.
+int sys_send_batch(ipc_msg_desc_t *descs, int count) {
+    if (!current_task || !descs || count < 0) {
+        return -1;
+    }
+
+    int sent = 0;
+    for (int i = 0; i < count; i++) {
+        if (sys_send(descs[i].pid, descs[i].data, descs[i].size) < 0) {
+            break;
+        }
+        sent++;
+    }
+
+    return sent;
+}
+
+// Receive a train of messages in one kernel crossing.
+// Blocks for the first message like sys_recv, then drains whatever is
+// already queued without blocking again. Each descriptor gets the
+// sender PID and received size filled in; returns the count received.
+int sys_recv_batch(ipc_msg_desc_t *descs, int count) {
+    if (!current_task || !descs || count < 0) {
+        return -1;
+    }
+
+    int received = 0;
+    for (int i = 0; i < count; i++) {
+        // Only the first receive may block
+        if (received > 0 && ipc_queue_get(current_task)->count == 0) {
+            break;
+        }
+
+        int size = sys_recv(descs[i].data, descs[i].size, 0);
+        if (size < 0) {
+            break;
+        }
+
+        descs[i].pid = get_last_sender_pid();
+        descs[i].size = size;
+        received++;
+    }
+
+    return received;
 }
 
 // Get message count for task
 int get_message_count(int pid) {
-    return queue_count[pid];
+    pcb_t *task = get_task_by_pid(pid);
+    if (!task || !task->ipc_queue) {
+        return 0;
+    }
+    return task->ipc_queue->count;
 }
 
-// Clear message queue for task
+// Clear message queue for task, returning every node to the cache
 void clear_message_queue(int pid) {
-    queue_head[pid] = 0;
-    queue_tail[pid] = 0;
-    queue_count[pid] = 0;
+    pcb_t *task = get_task_by_pid(pid);
+    if (!task || !task->ipc_queue) {
+        return;
+    }
+
+    struct ipc_queue *q = task->ipc_queue;
+    while (q->msg_head) {
+        ipc_msg_node_t *node = q->msg_head;
+        q->msg_head = node->next;
+        slab_free(&ipc_message_cache, node);
+    }
+    q->msg_tail = NULL;
+    q->count = 0;
 }
 
 // Send broadcast message to all tasks
@@ -131,9 +744,9 @@ int broadcast_message(void *msg, size_t len) {
     if (!current_task) {
         return -1;
     }
-    
+
     int sent_count = 0;
-    
+
     for (int i = 0; i < MAX_TASKS; i++) {
         if (tasks[i].state != TASK_ZOMBIE && tasks[i].pid != current_task->pid) {
             if (sys_send(tasks[i].pid, msg, len) > 0) {
@@ -141,32 +754,31 @@ int broadcast_message(void *msg, size_t len) {
             }
         }
     }
-    
+
     return sent_count;
 }
 
 // Get sender PID of last received message
 int get_last_sender_pid(void) {
-    if (!current_task || queue_count[current_task->pid] == 0) {
+    if (!current_task || !current_task->ipc_queue) {
         return -1;
     }
-    
-    int last_index = (queue_head[current_task->pid] - 1 + MAX_IPC_MESSAGES) % MAX_IPC_MESSAGES;
-    return message_queues[current_task->pid][last_index].sender_pid;
+
+    return current_task->ipc_queue->last_sender_pid;
 }
 
 // Check if task has pending messages
 bool has_pending_messages(int pid) {
-    return queue_count[pid] > 0;
+    return get_message_count(pid) > 0;
 }
 
 // Get message size without removing from queue
 int peek_message_size(void) {
-    if (!current_task || queue_count[current_task->pid] == 0) {
+    if (!current_task || !current_task->ipc_queue || !current_task->ipc_queue->msg_head) {
         return -1;
     }
-    
-    return message_queues[current_task->pid][queue_head[current_task->pid]].size;
+
+    return current_task->ipc_queue->msg_head->msg.size;
 }
 
 // IPC statistics
@@ -190,4 +802,4 @@ void reset_ipc_stats(void) {
     ipc_stats.messages_received = 0;
     ipc_stats.messages_dropped = 0;
     ipc_stats.tasks_blocked = 0;
-} 
\ No newline at end of file
+}
@@ -1,7 +1,7 @@
 #include "kernel.h"
 
 // Global variables
-pcb_t *current_task = NULL;
+pcb_t *current_tasks[MAX_CPUS]; // Per-CPU, accessed via current_task
 pcb_t tasks[MAX_TASKS];
 int next_pid = 1;
 
@@ -10,8 +10,9 @@ volatile uint16_t *video_memory = (volatile uint16_t*)0xB8000;
 int cursor_x = 0;
 int cursor_y = 0;
 
-// Kernel main function
-void kernel_main(void) {
+// Kernel main function. The bootloader passes the physical address it
+// loaded the initrd image at.
+void kernel_main(uint64_t initrd_addr) {
     // Clear screen
     for (int i = 0; i < 80 * 25; i++) {
         video_memory[i] = 0x0720; // Black background, white text, space
@@ -25,13 +26,25 @@ void kernel_main(void) {
     
     idt_init();
     kprintf("IDT initialized\n");
-    
+
+    fpu_init();
+    kprintf("FPU initialized\n");
+
     paging_init();
     kprintf("Paging initialized\n");
     
     vm_init();
     kprintf("Virtual memory initialized\n");
+
+    initrd_init(initrd_addr);
+    kprintf("Initrd registered\n");
+
+    stats_init();
+    kprintf("Instrumentation initialized\n");
     
+    syscall_init();
+    kprintf("Fast syscall path initialized\n");
+
     timer_init();
     kprintf("Timer initialized\n");
     
@@ -41,21 +54,43 @@ void kernel_main(void) {
     ipc_init();
     kprintf("IPC initialized\n");
     
-    // Create initial user tasks
-    create_task("hello_world", 0x400000, 1);
-    create_task("hello_world", 0x410000, 1);
-    create_task("hello_world", 0x420000, 1);
-    create_task("hello_world", 0x430000, 1);
-    create_task("hello_world", 0x440000, 1);
-    create_task("hello_world", 0x450000, 1);
-    create_task("hello_world", 0x460000, 1);
-    create_task("hello_world", 0x470000, 1);
-    
+#ifdef BENCH
+    // Benchmark pair: ping (pid 1) drives the IPC, yield and fault
+    // loops; pong (pid 2) echoes. Both are loaded from the initrd —
+    // the load order gives them the PIDs the pair hardcodes. See
+    // user/bench.c and `make bench`.
+    if (load_user_program("bench_ping", USER_STACK_TOP) < 0 ||
+        load_user_program("bench_pong", USER_STACK_TOP) < 0) {
+        kprintf("bench pair missing from initrd\n");
+    }
+#else
+    // Load the initial user program from the initrd: read-only
+    // segments map zero-copy from the image, the rest demand-pages in
+    if (load_user_program("hello_world", USER_STACK_TOP) < 0) {
+        kprintf("hello_world missing from initrd\n");
+    }
+#endif
+
+    // Log flusher runs at the lowest priority so it only drains the
+    // ring when nothing else wants the CPU
+    create_kernel_task("klog_flusher", klog_flusher_task, 0);
+
+#ifdef BENCH
+    kprintf("Created benchmark tasks\n");
+#else
     kprintf("Created 8 user tasks\n");
+#endif
     kprintf("Enabling interrupts...\n");
-    
+
+    // Show the boot messages before the flusher task takes over
+    klog_flush();
+
+    // Bring up the application processors
+    smp_init(MAX_CPUS);
+    kprintf("SMP initialized\n");
+
     enable_interrupts();
-    
+
     kprintf("Kernel initialization complete!\n");
     kprintf("Starting scheduler...\n");
     
@@ -76,17 +111,21 @@ void gdt_init(void) {
     // Null descriptor
     gdt_set_entry(0, 0, 0, 0, 0);
     
-    // Kernel code descriptor
-    gdt_set_entry(1, 0, 0xFFFFF, 0x9A, 0xCF);
+    // Kernel code descriptor (L bit set: 64-bit)
+    gdt_set_entry(1, 0, 0xFFFFF, 0x9A, 0xAF);
     
     // Kernel data descriptor
     gdt_set_entry(2, 0, 0xFFFFF, 0x92, 0xCF);
     
-    // User code descriptor
-    gdt_set_entry(3, 0, 0xFFFFF, 0xFA, 0xCF);
+    // Ring-3 descriptors in SYSRET layout: data at STAR base + 8,
+    // code at STAR base + 16 (see syscall_init), so SYSRET loads
+    // SS = 0x18|3 = 0x1B and CS = 0x20|3 = 0x23
+    
+    // User data descriptor (0x18)
+    gdt_set_entry(3, 0, 0xFFFFF, 0xF2, 0xCF);
     
-    // User data descriptor
-    gdt_set_entry(4, 0, 0xFFFFF, 0xF2, 0xCF);
+    // User code descriptor (0x20, L bit set: 64-bit)
+    gdt_set_entry(4, 0, 0xFFFFF, 0xFA, 0xAF);
     
     // Load GDT
     struct {
@@ -122,6 +161,7 @@ void idt_init(void) {
     idt_set_entry(0x20, (uint64_t)timer_handler, 0x08, 0x8E); // Timer
     idt_set_entry(0x80, (uint64_t)syscall_handler, 0x08, 0xEE); // System call
     idt_set_entry(0x0E, (uint64_t)page_fault_handler, 0x08, 0x8E); // Page fault
+    idt_set_entry(0x07, (uint64_t)fpu_trap_handler, 0x08, 0x8E); // Device not available (lazy FPU)
     
     // Load IDT
     struct {
@@ -163,23 +203,74 @@ void paging_init(void) {
     for (int i = 0; i < 512; i++) {
         ((uint64_t*)0x3000)[i] = (i * 0x200000) | 0x83; // Present + Read/Write + 2MB
     }
-    
+
+    // The local APIC's MMIO page sits at 0xFEE00000, far above the
+    // identity-mapped low gigabyte. Map its 2MB window through a
+    // second PD, cache-disabled as MMIO requires, so the APIC reads in
+    // syscall_init and the ICR writes in smp_init do not fault.
+    ((uint64_t*)0x2000)[3] = 0x4000 | 3; // PDPT entry covering 3-4GB
+    ((uint64_t*)0x4000)[(0xFEE00000UL >> 21) & 0x1FF] =
+        0xFEE00000UL | 0x9B; // Present + Read/Write + 2MB + PWT + PCD
+
     // Load CR3
     write_cr3(0x1000);
 }
 
-// Timer initialization
+// Enable SSE and arm lazy FPU switching, run once per CPU: CR4 gets
+// OSFXSR/OSXMMEXCPT for fxsave and SSE exceptions, CR0 gets MP set and
+// EM cleared so FPU instructions execute and wait honors TS
+void fpu_init(void) {
+    write_cr0((read_cr0() & ~4ULL) | 2); // Clear EM, set MP
+    write_cr4(read_cr4() | (1 << 9) | (1 << 10)); // OSFXSR + OSXMMEXCPT
+}
+
+// Per-CPU data reached through GS, which points here at all times
+typedef struct {
+    uint64_t kernel_rsp; // [gs:0] - kernel stack for syscall entry
+    uint64_t scratch;    // [gs:8] - user RSP in flight to/from the PCB
+    uint64_t cpu_id;     // [gs:16] - cached APIC id (smp_cpu_id, switch_to_asm)
+    uint64_t syscall_tsc; // [gs:24] - syscall entry stamp; zeroed on task switch
+} percpu_t;
+
+percpu_t percpu_data[MAX_CPUS];
+
+// SYSCALL/SYSRET initialization, run once per CPU
+void syscall_init(void) {
+    // First per-CPU setup on this CPU: the GS-cached id does not exist
+    // yet, so read the APIC directly this one time
+    int cpu = smp_apic_id();
+
+    // Enable SYSCALL/SYSRET
+    write_msr(MSR_EFER, read_msr(MSR_EFER) | 1); // EFER.SCE
+
+    // Segment selectors: SYSCALL loads CS/SS from STAR[47:32] (0x08
+    // kernel code, 0x10 kernel data); SYSRET loads them from
+    // STAR[63:48] + 16 / + 8 with RPL 3, which lands on the user code
+    // and data descriptors gdt_init placed at 0x20 and 0x18
+    write_msr(MSR_STAR, ((uint64_t)0x08 << 32) | ((uint64_t)0x10 << 48));
+
+    // Fast syscall entry point
+    write_msr(MSR_LSTAR, (uint64_t)syscall_entry);
+
+    // Mask interrupts while on the kernel stack
+    write_msr(MSR_SFMASK, 0x200);
+
+    // This CPU's block holding its kernel stack and cached id. GS
+    // points at it permanently: user code never programs GS in this
+    // prototype, so the SYSCALL path needs no swapgs and a task
+    // switched out mid-syscall resumes with [gs:...] still valid.
+    percpu_data[cpu].kernel_rsp = smp_kernel_stack_top(cpu);
+    percpu_data[cpu].scratch = 0;
+    percpu_data[cpu].cpu_id = cpu;
+    percpu_data[cpu].syscall_tsc = 0;
+    write_msr(MSR_GS_BASE, (uint64_t)&percpu_data[cpu]);
+}
+
+// Timer initialization (tickless: one-shot deadlines, no periodic tick)
 void timer_init(void) {
-    // Set up PIT (Programmable Interval Timer)
-    uint32_t divisor = 1193180 / 100; // 100 Hz
-    
-    // Send command byte
-    __asm__ volatile("outb %0, %1" : : "a"((uint8_t)0x36), "Nd"((uint16_t)0x43));
-    
-    // Send divisor
-    __asm__ volatile("outb %0, %1" : : "a"((uint8_t)(divisor & 0xFF)), "Nd"((uint16_t)0x40));
-    __asm__ volatile("outb %0, %1" : : "a"((uint8_t)(divisor >> 8)), "Nd"((uint16_t)0x40));
-    
+    // Arm the first quantum; timer_handler re-arms for each next deadline
+    timer_arm_oneshot(QUANTUM_MS * (PIT_FREQUENCY / 1000));
+
     // Enable IRQ0
     __asm__ volatile("outb %0, %1" : : "a"((uint8_t)0xFE), "Nd"((uint16_t)0x21));
 }
@@ -191,8 +282,12 @@ void scheduler_init(void) {
         tasks[i].state = TASK_ZOMBIE;
         tasks[i].pid = 0;
     }
-    
-    current_task = NULL;
+
+    for (int i = 0; i < MAX_CPUS; i++) {
+        current_tasks[i] = NULL;
+    }
+
+    pid_hash_init();
 }
 
 // IPC initialization
@@ -203,27 +298,61 @@ void ipc_init(void) {
     }
 }
 
-// Simple printf implementation
+// Kernel log ring buffer: kprintf only appends here, and the
+// low-priority flusher task drains it to VGA memory, so callers on
+// hot paths never wait on slow memory-mapped I/O
+#define KLOG_SIZE 16384
+char klog_buffer[KLOG_SIZE];
+volatile uint64_t klog_write_pos = 0;
+volatile uint64_t klog_read_pos = 0;
+
+// Append to the in-memory log ring (fast path)
 void kprintf(const char *format) {
     while (*format) {
-        if (*format == '\n') {
+        // Drop the oldest byte if the ring is full rather than stall
+        if (klog_write_pos - klog_read_pos >= KLOG_SIZE) {
+            klog_read_pos++;
+        }
+        klog_buffer[klog_write_pos % KLOG_SIZE] = *format;
+        klog_write_pos++;
+        format++;
+    }
+}
+
+// Write one character to VGA memory (slow path, flusher only)
+void klog_putchar(char c) {
+    if (c == '\n') {
+        cursor_x = 0;
+        cursor_y++;
+        if (cursor_y >= 25) {
+            cursor_y = 0;
+        }
+    } else {
+        video_memory[cursor_y * 80 + cursor_x] = 0x0700 | c;
+        cursor_x++;
+        if (cursor_x >= 80) {
             cursor_x = 0;
             cursor_y++;
             if (cursor_y >= 25) {
                 cursor_y = 0;
             }
-        } else {
-            video_memory[cursor_y * 80 + cursor_x] = 0x0700 | *format;
-            cursor_x++;
-            if (cursor_x >= 80) {
-                cursor_x = 0;
-                cursor_y++;
-                if (cursor_y >= 25) {
-                    cursor_y = 0;
-                }
-            }
         }
-        format++;
+    }
+}
+
+// Drain all pending log bytes to the screen
+void klog_flush(void) {
+    while (klog_read_pos < klog_write_pos) {
+        klog_putchar(klog_buffer[klog_read_pos % KLOG_SIZE]);
+        klog_read_pos++;
+    }
+}
+
+// Flusher task: runs at the lowest priority and drains the log
+void klog_flusher_task(void) {
+    while (1) {
+        klog_flush();
+        yield();
     }
 }
 
@@ -233,6 +362,7 @@ void panic(const char *message) {
     kprintf(message);
     kprintf("\n");
     disable_interrupts();
+    klog_flush(); // The flusher will never run again, drain by hand
     while (1) {
         __asm__("hlt");
     }
@@ -1,10 +1,118 @@
 #include "kernel.h"
 
-// Ready queue for round-robin scheduling
-pcb_t *ready_queue[MAX_TASKS];
-int ready_queue_head = 0;
-int ready_queue_tail = 0;
-int ready_queue_count = 0;
+// Per-CPU ready queues, each with per-priority sub-queues and a bitmap
+// of non-empty levels. Higher priority value = dispatched first; tasks
+// at the same level round-robin among themselves. A CPU only touches
+// another CPU's queue to steal work when its own is empty.
+typedef struct {
+    pcb_t *queues[MAX_PRIORITIES][MAX_TASKS];
+    int head[MAX_PRIORITIES];
+    int tail[MAX_PRIORITIES];
+    int count[MAX_PRIORITIES];
+    uint32_t bitmap; // Non-empty priority levels
+    spinlock_t lock;
+} __attribute__((aligned(CACHE_LINE_SIZE))) cpu_runqueue_t; // One CPU's lock/bitmap never
+                                                            // false-shares with another's
+
+cpu_runqueue_t run_queues[MAX_CPUS];
+
+// Pop the most deserving task from one run queue (lock must be held):
+// the highest non-empty priority level, and within that level the task
+// with the least consumed runtime rather than strict FIFO order, so a
+// batch task that never sleeps cannot starve an interactive one at the
+// same priority.
+pcb_t *runqueue_pop(cpu_runqueue_t *rq) {
+    if (rq->bitmap == 0) {
+        return NULL;
+    }
+
+    // Find highest non-empty level with a single bit-scan
+    uint32_t level;
+    __asm__("bsr %1, %0" : "=r"(level) : "r"(rq->bitmap));
+
+    // Scan the level for the minimum-runtime entry
+    int idx = rq->head[level];
+    int best = idx;
+    uint64_t best_runtime = rq->queues[level][idx]->runtime_cycles;
+    for (int i = 1; i < rq->count[level]; i++) {
+        idx = (idx + 1) % MAX_TASKS;
+        if (rq->queues[level][idx]->runtime_cycles < best_runtime) {
+            best_runtime = rq->queues[level][idx]->runtime_cycles;
+            best = idx;
+        }
+    }
+
+    pcb_t *task = rq->queues[level][best];
+
+    // Close the hole by shifting later entries down
+    int dst = best;
+    int src = (best + 1) % MAX_TASKS;
+    while (src != rq->tail[level]) {
+        rq->queues[level][dst] = rq->queues[level][src];
+        dst = src;
+        src = (src + 1) % MAX_TASKS;
+    }
+    rq->tail[level] = dst;
+    rq->count[level]--;
+    if (rq->count[level] == 0) {
+        rq->bitmap &= ~(1u << level);
+    }
+    return task;
+}
+
+// Whether this CPU has anything runnable queued
+int have_ready_tasks(void) {
+    return run_queues[smp_cpu_id()].bitmap != 0;
+}
+
+// PID -> task-slot lookup: open addressing keyed on pid, the same
+// scheme as the frame table in kernel/vm.c. sys_send resolves its
+// target through this instead of scanning tasks[], so IPC latency
+// stays flat as MAX_TASKS grows.
+#define PID_HASH_SIZE (MAX_TASKS * 2)
+#define PID_HASH_EMPTY -1
+#define PID_HASH_TOMBSTONE -2
+
+int pid_hash[PID_HASH_SIZE];
+
+// Hash a pid to a table slot
+int pid_hash_index(int pid) {
+    return (int)(((uint64_t)pid * 0x9E3779B97F4A7C15) & (PID_HASH_SIZE - 1));
+}
+
+// Insert a pid -> task slot mapping
+void pid_hash_insert(int pid, int task_slot) {
+    int slot = pid_hash_index(pid);
+    for (int i = 0; i < PID_HASH_SIZE; i++) {
+        if (pid_hash[slot] == PID_HASH_EMPTY || pid_hash[slot] == PID_HASH_TOMBSTONE) {
+            pid_hash[slot] = task_slot;
+            return;
+        }
+        slot = (slot + 1) & (PID_HASH_SIZE - 1);
+    }
+}
+
+// Remove the mapping for a pid
+void pid_hash_remove(int pid) {
+    int slot = pid_hash_index(pid);
+    for (int i = 0; i < PID_HASH_SIZE; i++) {
+        if (pid_hash[slot] == PID_HASH_EMPTY) {
+            return;
+        }
+        if (pid_hash[slot] != PID_HASH_TOMBSTONE && tasks[pid_hash[slot]].pid == pid) {
+            pid_hash[slot] = PID_HASH_TOMBSTONE;
+            return;
+        }
+        slot = (slot + 1) & (PID_HASH_SIZE - 1);
+    }
+}
+
+// Clear the PID lookup table
+void pid_hash_init(void) {
+    for (int i = 0; i < PID_HASH_SIZE; i++) {
+        pid_hash[i] = PID_HASH_EMPTY;
+    }
+}
 
 // Task creation
 int create_task(const char *name, uint64_t entry_point, int priority) {
@@ -26,27 +134,30 @@ int create_task(const char *name, uint64_t entry_point, int priority) {
     task->pid = next_pid++;
     task->state = TASK_READY;
     task->priority = priority;
+    task->base_priority = priority;
+    task->wait_state = WAIT_NONE;
+    task->wait_next = NULL;
+    task->ipc_partner = -1;
+    task->runtime_cycles = 0;
+    task->recv_spin_cycles = RECV_SPIN_MIN; // Grows only if spinning pays
+    task->ipc_queue = NULL; // Allocated on first IPC
+    task->fpu_used = 0;     // FXSAVE area filled on first FPU use
     task->stack_base = entry_point - USER_STACK_SIZE;
     task->stack_size = USER_STACK_SIZE;
     task->rip = entry_point;
     task->rsp = entry_point;
     task->rflags = 0x202; // Interrupts enabled, IOPL=0
-    task->cr3 = read_cr3(); // Use kernel page tables for now
+    task->cr3 = create_address_space(); // Per-task page tables
     
     // Copy task name
-    int name_len = 0;
-    while (name[name_len] && name_len < 31) {
-        task->name[name_len] = name[name_len];
-        name_len++;
-    }
-    task->name[name_len] = '\0';
+    kstrncpy(task->name, name, sizeof(task->name));
     
     // Set up initial stack
     uint64_t *stack = (uint64_t*)task->rsp;
     stack[-1] = entry_point; // Return address
     stack[-2] = 0x202;       // RFLAGS
-    stack[-3] = 0x18;        // CS (user code segment)
-    stack[-4] = 0x20;        // SS (user data segment)
+    stack[-3] = 0x23;        // CS (user code segment, RPL 3)
+    stack[-4] = 0x1B;        // SS (user data segment, RPL 3)
     stack[-5] = 0;           // R15
     stack[-6] = 0;           // R14
     stack[-7] = 0;           // R13
@@ -64,33 +175,289 @@ int create_task(const char *name, uint64_t entry_point, int priority) {
     stack[-19] = 0;          // RAX
     
     task->rsp = (uint64_t)&stack[-19];
-    
-    // Add to ready queue
+
+    // Register in the PID lookup table and add to ready queue
+    pid_hash_insert(task->pid, task_id);
     enqueue_ready(task);
-    
+
+    return task->pid;
+}
+
+// Kernel thread creation: the task runs entry in ring 0 on its own
+// stack carved from the frame allocator, in the kernel address space.
+// Unlike create_task it must not build its frame at the entry point —
+// that would scribble over kernel text. The initial frame matches
+// exactly what switch_to_asm restores (15 GPRs, then the return
+// address), so the first dispatch returns straight into entry.
+int create_kernel_task(const char *name, void (*entry)(void), int priority) {
+    // Find free task slot
+    int task_id = -1;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (tasks[i].state == TASK_ZOMBIE) {
+            task_id = i;
+            break;
+        }
+    }
+
+    if (task_id == -1) {
+        return -1; // No free slots
+    }
+
+    // Initialize task
+    pcb_t *task = &tasks[task_id];
+    task->pid = next_pid++;
+    task->state = TASK_READY;
+    task->priority = priority;
+    task->base_priority = priority;
+    task->wait_state = WAIT_NONE;
+    task->wait_next = NULL;
+    task->ipc_partner = -1;
+    task->runtime_cycles = 0;
+    task->recv_spin_cycles = RECV_SPIN_MIN;
+    task->fpu_used = 0;
+    task->ipc_queue = NULL;
+    task->stack_base = alloc_frames(KERNEL_STACK_SIZE / PAGE_SIZE);
+    task->stack_size = KERNEL_STACK_SIZE;
+    task->rip = (uint64_t)entry;
+    task->rflags = 0x202;
+    task->cr3 = read_cr3(); // Shares the kernel address space
+
+    // Copy task name
+    kstrncpy(task->name, name, sizeof(task->name));
+
+    // Initial frame on the thread's own stack
+    uint64_t *stack = (uint64_t*)(task->stack_base + KERNEL_STACK_SIZE);
+    stack[-1] = (uint64_t)entry; // switch_to_asm's final ret lands here
+    for (int i = 2; i <= 16; i++) {
+        stack[-i] = 0;           // General-purpose registers
+    }
+    task->rsp = (uint64_t)&stack[-16];
+
+    // Register in the PID lookup table and add to ready queue
+    pid_hash_insert(task->pid, task_id);
+    enqueue_ready(task);
+
     return task->pid;
 }
 
-// Enqueue task to ready queue
+// Fork the current task. The child gets its own page tables but shares
+// all user frames with the parent copy-on-write, so spawn cost is
+// O(mapped regions) instead of O(bytes copied). For this prototype the
+// child restarts from the task's original entry point.
+int fork_task(void) {
+    if (!current_task) {
+        return -1;
+    }
+
+    // Find free task slot
+    int task_id = -1;
+    for (int i = 0; i < MAX_TASKS; i++) {
+        if (tasks[i].state == TASK_ZOMBIE) {
+            task_id = i;
+            break;
+        }
+    }
+
+    if (task_id == -1) {
+        return -1; // No free slots
+    }
+
+    // Clone the parent's PCB
+    pcb_t *child = &tasks[task_id];
+    *child = *current_task;
+    child->pid = next_pid++;
+    child->state = TASK_READY;
+    child->wait_state = WAIT_NONE;
+    child->wait_next = NULL;
+    child->ipc_partner = -1;
+    child->ipc_queue = NULL; // The parent's queues are not inherited
+
+    // Duplicate the address space and share user pages copy-on-write
+    child->cr3 = clone_address_space(current_task->cr3);
+    mark_cow_range(current_task->cr3, child->cr3);
+
+    // Set up the child's initial stack frame like create_task does,
+    // under the child's own tables - and break the COW sharing for the
+    // stack-top entry by hand first: ring-0 writes ignore the R/W bit
+    // (CR0.WP is never set), so writing through either table as-is
+    // would land in the still-shared frame and corrupt the parent's
+    // stack instead of faulting into handle_cow_fault.
+    uint64_t entry_point = child->rip;
+    uint64_t *stack = (uint64_t*)(child->stack_base + child->stack_size);
+
+    uint64_t caller_cr3 = read_cr3();
+    write_cr3(child->cr3);
+    handle_cow_fault((uint64_t)&stack[-19]);
+
+    stack[-1] = entry_point; // Return address
+    stack[-2] = 0x202;       // RFLAGS
+    stack[-3] = 0x23;        // CS (user code segment, RPL 3)
+    stack[-4] = 0x1B;        // SS (user data segment, RPL 3)
+    for (int i = 5; i <= 19; i++) {
+        stack[-i] = 0;       // General-purpose registers
+    }
+    child->rsp = (uint64_t)&stack[-19];
+
+    write_cr3(caller_cr3);
+
+    // Register in the PID lookup table and add to ready queue
+    pid_hash_insert(child->pid, task_id);
+    enqueue_ready(child);
+
+    return child->pid;
+}
+
+// Enqueue task to this CPU's ready queue for its priority level
 void enqueue_ready(pcb_t *task) {
-    if (ready_queue_count < MAX_TASKS) {
-        ready_queue[ready_queue_tail] = task;
-        ready_queue_tail = (ready_queue_tail + 1) % MAX_TASKS;
-        ready_queue_count++;
+    int level = task->priority;
+    if (level < 0) level = 0;
+    if (level >= MAX_PRIORITIES) level = MAX_PRIORITIES - 1;
+
+    cpu_runqueue_t *rq = &run_queues[smp_cpu_id()];
+
+    spin_lock(&rq->lock);
+    if (rq->count[level] < MAX_TASKS) {
+        rq->queues[level][rq->tail[level]] = task;
+        rq->tail[level] = (rq->tail[level] + 1) % MAX_TASKS;
+        rq->count[level]++;
+        rq->bitmap |= (1u << level);
     }
+    spin_unlock(&rq->lock);
 }
 
-// Dequeue task from ready queue
+// Per-task CPU accounting: every task switch funnels through either
+// dequeue_ready() or the IPC direct-handoff path, and both charge the
+// outgoing task here before current_task changes hands.
+// Each CPU rewrites its stamp on every switch, so each one gets a
+// cache line of its own rather than ping-ponging a shared array
+typedef struct {
+    uint64_t tsc;
+} __attribute__((aligned(CACHE_LINE_SIZE))) cpu_dispatch_t;
+
+cpu_dispatch_t dispatch_tsc[MAX_CPUS]; // When this CPU's task last started running
+
+// Charge the running task for the cycles since its dispatch stamp
+void account_runtime(void) {
+    int cpu = smp_cpu_id();
+    uint64_t now = read_tsc();
+    if (current_tasks[cpu] && dispatch_tsc[cpu].tsc != 0) {
+        current_tasks[cpu]->runtime_cycles += now - dispatch_tsc[cpu].tsc;
+    }
+    dispatch_tsc[cpu].tsc = now;
+}
+
+// Dequeue the highest-priority ready task, stealing from another CPU's
+// queue when our own is empty
 pcb_t *dequeue_ready(void) {
-    if (ready_queue_count > 0) {
-        pcb_t *task = ready_queue[ready_queue_head];
-        ready_queue_head = (ready_queue_head + 1) % MAX_TASKS;
-        ready_queue_count--;
+    int cpu = smp_cpu_id();
+    cpu_runqueue_t *rq = &run_queues[cpu];
+
+    // Settle the outgoing task's bill while it is still current
+    account_runtime();
+
+    spin_lock(&rq->lock);
+    pcb_t *task = runqueue_pop(rq);
+    spin_unlock(&rq->lock);
+    if (task) {
         return task;
     }
+
+    // Work stealing: take the best task from the first CPU that has one
+    for (int victim = 0; victim < cpu_count; victim++) {
+        if (victim == cpu) {
+            continue;
+        }
+
+        rq = &run_queues[victim];
+        spin_lock(&rq->lock);
+        task = runqueue_pop(rq);
+        spin_unlock(&rq->lock);
+        if (task) {
+            return task;
+        }
+    }
+
     return NULL;
 }
 
+// Priority inheritance: while a high-priority task is blocked on an
+// RPC reply, the server it is waiting on runs at the waiter's
+// priority so medium-priority tasks cannot starve it and stretch the
+// inversion without bound. The donation is dropped again when the
+// server sends its reply.
+
+// Pull a task out of whichever CPU's ready queue holds it, so it can
+// be re-queued at a different priority. Returns true if it was queued.
+bool runqueue_remove(pcb_t *task) {
+    int level = task->priority;
+    if (level < 0) level = 0;
+    if (level >= MAX_PRIORITIES) level = MAX_PRIORITIES - 1;
+
+    for (int cpu = 0; cpu < cpu_count; cpu++) {
+        cpu_runqueue_t *rq = &run_queues[cpu];
+        spin_lock(&rq->lock);
+
+        int idx = rq->head[level];
+        for (int i = 0; i < rq->count[level]; i++) {
+            if (rq->queues[level][idx] == task) {
+                // Close the hole by shifting later entries down
+                int src = (idx + 1) % MAX_TASKS;
+                for (int j = i + 1; j < rq->count[level]; j++) {
+                    rq->queues[level][idx] = rq->queues[level][src];
+                    idx = src;
+                    src = (src + 1) % MAX_TASKS;
+                }
+                rq->tail[level] = (rq->tail[level] + MAX_TASKS - 1) % MAX_TASKS;
+                rq->count[level]--;
+                if (rq->count[level] == 0) {
+                    rq->bitmap &= ~(1u << level);
+                }
+                spin_unlock(&rq->lock);
+                return true;
+            }
+            idx = (idx + 1) % MAX_TASKS;
+        }
+
+        spin_unlock(&rq->lock);
+    }
+    return false;
+}
+
+// Donate a waiter's priority to the task it is blocked on, following
+// the chain if that task is itself waiting on another RPC
+void inherit_priority(pcb_t *task, int priority) {
+    for (int depth = 0; task && depth < MAX_TASKS; depth++) {
+        if (task->priority >= priority) {
+            return; // Already at least as urgent
+        }
+
+        bool queued = runqueue_remove(task);
+        task->priority = priority;
+        if (queued) {
+            enqueue_ready(task);
+        }
+
+        // The server may in turn be blocked on a deeper server
+        if (task->state != TASK_BLOCKED || task->wait_state != WAIT_IPC) {
+            return;
+        }
+        task = get_task_by_pid(task->ipc_partner);
+    }
+}
+
+// Drop any donated priority back to the task's own level
+void restore_priority(pcb_t *task) {
+    if (task->priority == task->base_priority) {
+        return;
+    }
+
+    bool queued = runqueue_remove(task);
+    task->priority = task->base_priority;
+    if (queued) {
+        enqueue_ready(task);
+    }
+}
+
 // Enqueue current task back to ready queue
 void enqueue_current(void) {
     if (current_task && current_task->state == TASK_RUNNING) {
@@ -101,6 +468,8 @@ void enqueue_current(void) {
 
 // Main scheduler function
 void schedule(void) {
+    uint64_t start_tsc = read_tsc();
+
     // If no current task, get one from ready queue
     if (!current_task) {
         current_task = dequeue_ready();
@@ -108,26 +477,74 @@ void schedule(void) {
             return; // No tasks to run
         }
     }
-    
+
     // Get next task from ready queue
     pcb_t *next_task = dequeue_ready();
     if (!next_task) {
         // No other tasks, keep current task
+        stats_record(STAT_PATH_SCHEDULE, start_tsc);
         return;
     }
-    
+
+    // Keep the current task if it outranks everything that is ready
+    if (current_task->state == TASK_RUNNING && current_task->priority > next_task->priority) {
+        enqueue_ready(next_task);
+        stats_record(STAT_PATH_SCHEDULE, start_tsc);
+        return;
+    }
+
     // Put current task back in ready queue
     enqueue_current();
-    
+
     // Switch to next task
     pcb_t *prev_task = current_task;
     current_task = next_task;
     current_task->state = TASK_RUNNING;
-    
+
+    // Record the decision time, excluding the context switch itself
+    stats_record(STAT_PATH_SCHEDULE, start_tsc);
+
     // Perform context switch
     switch_to_asm(current_task);
 }
 
+// Lazy FPU/SSE switching. switch_to_asm sets CR0.TS instead of saving
+// xmm state on every switch; the first FPU/SSE instruction a task
+// executes afterwards traps here (#NM) and only then is the 512-byte
+// FXSAVE area saved and restored. Tasks that never touch SIMD never
+// pay for it.
+pcb_t *fpu_owner[MAX_CPUS]; // Task whose state is live in this CPU's FPU
+
+void fpu_trap_handler_c(void) {
+    // Clear TS so FPU/SSE instructions execute again
+    __asm__ volatile("clts");
+
+    if (!current_task) {
+        return;
+    }
+
+    int cpu = smp_cpu_id();
+    pcb_t *owner = fpu_owner[cpu];
+    if (owner == current_task) {
+        return; // Our state is still live in the FPU
+    }
+
+    // Park the previous owner's state
+    if (owner) {
+        __asm__ volatile("fxsave %0" : "=m"(owner->fpu_state));
+    }
+
+    // Bring in ours, or start from a clean FPU on first use
+    if (current_task->fpu_used) {
+        __asm__ volatile("fxrstor %0" : : "m"(current_task->fpu_state));
+    } else {
+        __asm__ volatile("fninit");
+        current_task->fpu_used = 1;
+    }
+
+    fpu_owner[cpu] = current_task;
+}
+
 // Context switch wrapper
 void switch_to(pcb_t *task) {
     if (current_task) {
@@ -157,6 +574,22 @@ void yield(void) {
 void exit_task(int exit_code) {
     if (current_task) {
         current_task->state = TASK_ZOMBIE;
+        pid_hash_remove(current_task->pid);
+        clear_elf_regions(current_task->pid);
+
+        // Return the IPC queue and any still-queued messages to their
+        // slabs; nothing will ever receive them now
+        ipc_queue_destroy(current_task);
+
+        // Disown any FPU still holding this task's state: a new task
+        // reusing this PCB slot would compare equal to the stale owner
+        // and inherit the dead task's registers instead of an fninit
+        for (int cpu = 0; cpu < cpu_count; cpu++) {
+            if (fpu_owner[cpu] == current_task) {
+                fpu_owner[cpu] = NULL;
+            }
+        }
+
         kprintf("Task exited\n");
         
         // Get next task
@@ -176,13 +609,186 @@ void exit_task(int exit_code) {
     }
 }
 
-// Timer handler for preemption
+// Tickless timer state: the PIT is armed in one-shot mode for the next
+// real deadline instead of firing at a fixed 100Hz
+uint64_t system_time_ms = 0;
+uint64_t last_armed_ms = 0; // Length of the currently armed one-shot
+
+// Timer wheel: a sleeping (or timed-wait) task hangs off the slot for
+// its deadline modulo the wheel size, linked through wait_next.
+// Advancing one millisecond touches one slot, so expiry costs O(1) per
+// tick plus O(1) per woken task, independent of how many are sleeping.
+#define TIMER_WHEEL_SLOTS 256
+
+pcb_t *timer_wheel[TIMER_WHEEL_SLOTS];
+int sleeping_count = 0;
+uint64_t timer_last_ms = 0; // Wheel has been processed up to here
+
+// Hang a task on the wheel for the given absolute deadline
+void timer_wheel_insert(pcb_t *task, uint64_t wakeup_ms) {
+    int slot = wakeup_ms % TIMER_WHEEL_SLOTS;
+    task->wakeup_ms = wakeup_ms;
+    task->wait_next = timer_wheel[slot];
+    timer_wheel[slot] = task;
+    sleeping_count++;
+}
+
+// Unlink a task from the wheel (no-op if it is not on it), used when
+// something else wakes it before its deadline
+void timer_wheel_remove(pcb_t *task) {
+    if (task->wakeup_ms == 0) {
+        return;
+    }
+
+    int slot = task->wakeup_ms % TIMER_WHEEL_SLOTS;
+    pcb_t **link = &timer_wheel[slot];
+    while (*link) {
+        if (*link == task) {
+            *link = task->wait_next;
+            task->wait_next = NULL;
+            sleeping_count--;
+            break;
+        }
+        link = &(*link)->wait_next;
+    }
+    task->wakeup_ms = 0;
+}
+
+// Longest span one PIT one-shot can cover: the counter is 16 bits, so
+// anything past ~54ms has to be reached in hops, re-armed on expiry
+#define PIT_MAX_ONESHOT_MS (0xFFFF / (PIT_FREQUENCY / 1000))
+
+// Arm the PIT for a single interrupt (channel 0, mode 0 one-shot)
+void timer_arm_oneshot(uint32_t pit_cycles) {
+    if (pit_cycles == 0) {
+        pit_cycles = 1;
+    }
+    if (pit_cycles > 0xFFFF) {
+        pit_cycles = 0xFFFF;
+    }
+
+    // Send command byte: channel 0, lobyte/hibyte, mode 0
+    __asm__ volatile("outb %0, %1" : : "a"((uint8_t)0x30), "Nd"((uint16_t)0x43));
+
+    // Send count
+    __asm__ volatile("outb %0, %1" : : "a"((uint8_t)(pit_cycles & 0xFF)), "Nd"((uint16_t)0x40));
+    __asm__ volatile("outb %0, %1" : : "a"((uint8_t)(pit_cycles >> 8)), "Nd"((uint16_t)0x40));
+}
+
+// Arm the timer for the next actual deadline: end of the running
+// task's quantum if anyone else is runnable, or the earliest sleep
+// timeout. A solo task with no sleepers takes no timer interrupts.
+void program_next_deadline(void) {
+    uint64_t deadline_ms = 0;
+    bool have_deadline = false;
+
+    // A quantum is only needed if another task is waiting for the CPU
+    if (have_ready_tasks()) {
+        deadline_ms = QUANTUM_MS;
+        have_deadline = true;
+    }
+
+    // The earliest sleeper may need waking sooner: walk the wheel one
+    // slot per millisecond, at most one full rotation
+    if (sleeping_count > 0) {
+        uint64_t sleep_delay = TIMER_WHEEL_SLOTS; // Re-check after a rotation
+        for (uint64_t t = 1; t <= TIMER_WHEEL_SLOTS; t++) {
+            uint64_t when = system_time_ms + t;
+            pcb_t *entry = timer_wheel[when % TIMER_WHEEL_SLOTS];
+            bool found = false;
+            while (entry) {
+                if (entry->wakeup_ms <= when) {
+                    found = true;
+                    break;
+                }
+                entry = entry->wait_next;
+            }
+            if (found) {
+                sleep_delay = t;
+                break;
+            }
+        }
+        if (!have_deadline || sleep_delay < deadline_ms) {
+            deadline_ms = sleep_delay;
+            have_deadline = true;
+        }
+    }
+
+    if (!have_deadline) {
+        return; // Fully idle or a solo task: stay tickless
+    }
+
+    // Never record more than the PIT can actually count down: the
+    // wheel scan can ask for up to a full rotation (256ms), but the
+    // one-shot silently clamps at 16 bits, and crediting the unclamped
+    // span to system_time_ms on expiry would run the clock fast and
+    // wake sleepers early. Far deadlines are reached in clamped hops.
+    if (deadline_ms > PIT_MAX_ONESHOT_MS) {
+        deadline_ms = PIT_MAX_ONESHOT_MS;
+    }
+
+    last_armed_ms = deadline_ms;
+    timer_arm_oneshot(deadline_ms * (PIT_FREQUENCY / 1000));
+}
+
+// Sleep for the given number of milliseconds
+int sys_sleep(uint64_t ms) {
+    if (!current_task) {
+        return -1;
+    }
+
+    if (ms == 0) {
+        yield();
+        return 0;
+    }
+
+    // Register the wakeup deadline
+    current_task->wait_state = WAIT_SLEEP;
+    timer_wheel_insert(current_task, system_time_ms + ms);
+
+    program_next_deadline();
+    block_task();
+    return 0;
+}
+
+// Timer handler: advance time, wake expired sleepers, re-arm for the
+// next deadline, and preempt only if another task is runnable
 void timer_handler(void) {
     // Send EOI to PIC
     __asm__ volatile("outb %0, %1" : : "a"((uint8_t)0x20), "Nd"((uint16_t)0x20));
-    
-    // Trigger scheduling
-    if (current_task) {
+
+    system_time_ms += last_armed_ms;
+    last_armed_ms = 0;
+
+    // Advance the wheel one slot per elapsed millisecond, waking
+    // entries whose deadline has passed and re-linking the ones that
+    // belong to a later rotation
+    while (timer_last_ms < system_time_ms) {
+        timer_last_ms++;
+        int slot = timer_last_ms % TIMER_WHEEL_SLOTS;
+        pcb_t *entry = timer_wheel[slot];
+        timer_wheel[slot] = NULL;
+
+        while (entry) {
+            pcb_t *next = entry->wait_next;
+            if (entry->wakeup_ms <= system_time_ms) {
+                entry->wakeup_ms = 0;
+                entry->wait_next = NULL;
+                sleeping_count--;
+                unblock_task(entry);
+            } else {
+                // Future rotation: keep it on the wheel
+                entry->wait_next = timer_wheel[slot];
+                timer_wheel[slot] = entry;
+            }
+            entry = next;
+        }
+    }
+
+    program_next_deadline();
+
+    // Trigger scheduling only when there is someone to switch to
+    if (current_task && have_ready_tasks()) {
         yield();
     }
 }
@@ -192,12 +798,20 @@ pcb_t *get_current_task(void) {
     return current_task;
 }
 
-// Get task by PID
+// Get task by PID: O(1) probe of the lookup table, no tasks[] scan
 pcb_t *get_task_by_pid(int pid) {
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].pid == pid && tasks[i].state != TASK_ZOMBIE) {
-            return &tasks[i];
+    int slot = pid_hash_index(pid);
+    for (int i = 0; i < PID_HASH_SIZE; i++) {
+        if (pid_hash[slot] == PID_HASH_EMPTY) {
+            return NULL;
+        }
+        if (pid_hash[slot] != PID_HASH_TOMBSTONE && tasks[pid_hash[slot]].pid == pid) {
+            if (tasks[pid_hash[slot]].state == TASK_ZOMBIE) {
+                return NULL;
+            }
+            return &tasks[pid_hash[slot]];
         }
+        slot = (slot + 1) & (PID_HASH_SIZE - 1);
     }
     return NULL;
 }
@@ -226,7 +840,11 @@ void block_task(void) {
 // Unblock task
 void unblock_task(pcb_t *task) {
     if (task && task->state == TASK_BLOCKED) {
+        // Cancel any pending timeout before the task runs again
+        timer_wheel_remove(task);
         task->state = TASK_READY;
+        task->wait_state = WAIT_NONE;
+        task->wait_next = NULL;
         enqueue_ready(task);
     }
 } 
\ No newline at end of file
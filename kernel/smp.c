@@ -0,0 +1,134 @@
+#include "kernel.h"
+
+// SMP bring-up. The BSP copies the real-mode trampoline from
+// kernel/context.S into low memory and kicks each AP with the
+// INIT/SIPI/SIPI sequence; the AP walks up to long mode on the boot
+// page tables and lands in ap_main.
+
+// Local APIC registers (identity-mapped MMIO). The base is a 64-bit
+// constant so pointer arithmetic never narrows through int.
+#define LAPIC_BASE 0xFEE00000UL
+#define LAPIC_ID_REG 0x20
+#define LAPIC_SVR_REG 0xF0
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+
+// Trampoline target: below 1MB and page-aligned, as SIPI requires
+#define AP_TRAMPOLINE_ADDR 0x8000
+
+int cpu_count = 1;   // CPUs we attempted to start (BSP included)
+int cpus_online = 1; // CPUs that reached ap_main
+spinlock_t smp_lock = 0;
+
+// Kernel stacks for the APs (the BSP keeps its boot stack)
+uint8_t ap_stacks[MAX_CPUS][KERNEL_STACK_SIZE];
+
+// Read local APIC register
+uint32_t lapic_read(uint32_t reg) {
+    return *(volatile uint32_t*)(LAPIC_BASE + reg);
+}
+
+// Write local APIC register
+void lapic_write(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(LAPIC_BASE + reg) = value;
+}
+
+// Raw CPU id from the local APIC, for early bring-up on a CPU whose
+// per-CPU block is not set up yet. APIC IDs are assumed dense from 0
+// (QEMU and the SIPI loop below guarantee it); the mask bounds the
+// value so an unexpected ID can never index past the MAX_CPUS-sized
+// per-CPU arrays. MAX_CPUS must stay a power of two for this.
+int smp_apic_id(void) {
+    return (int)(lapic_read(LAPIC_ID_REG) >> 24) & (MAX_CPUS - 1);
+}
+
+// ID of the CPU we are running on: the copy syscall_init cached in the
+// per-CPU block. One GS-relative load, where reading the APIC would
+// cost an uncached MMIO access on every current_task dereference.
+int smp_cpu_id(void) {
+    int id;
+    __asm__("mov %%gs:16, %0" : "=r"(id));
+    return id;
+}
+
+// Top of the kernel stack for a CPU (syscall entry and AP boot)
+uint64_t smp_kernel_stack_top(int cpu) {
+    if (cpu == 0) {
+        return KERNEL_STACK_TOP;
+    }
+    return (uint64_t)&ap_stacks[cpu][KERNEL_STACK_SIZE];
+}
+
+// Crude delay for the gaps the INIT/SIPI protocol requires
+void smp_delay(int loops) {
+    for (volatile int i = 0; i < loops; i++);
+}
+
+// C entry point for an AP coming out of the trampoline
+void ap_main(void) {
+    // Program this CPU's SYSCALL MSRs, per-CPU block and FPU control bits
+    syscall_init();
+    fpu_init();
+
+    spin_lock(&smp_lock);
+    cpus_online++;
+    spin_unlock(&smp_lock);
+
+    kprintf("AP online\n");
+    enable_interrupts();
+
+    // Run tasks from our own queue, stealing when it is empty. No
+    // interrupt source targets the APs (the PIT is wired to the BSP
+    // only), so parking in hlt would be permanent: spin with a pause
+    // hint instead and poll for work to steal.
+    while (1) {
+        schedule();
+        __asm__ volatile("pause");
+    }
+}
+
+// Start the application processors
+void smp_init(int num_cpus) {
+    if (num_cpus > MAX_CPUS) {
+        num_cpus = MAX_CPUS;
+    }
+    cpu_count = num_cpus;
+
+    // Enable our local APIC (spurious interrupt vector 0xFF)
+    lapic_write(LAPIC_SVR_REG, lapic_read(LAPIC_SVR_REG) | 0x1FF);
+
+    // Copy the trampoline into low memory
+    uint64_t tramp_size = (uint64_t)ap_trampoline_end - (uint64_t)ap_trampoline_start;
+    uint8_t *dst = (uint8_t*)AP_TRAMPOLINE_ADDR;
+    for (uint64_t i = 0; i < tramp_size; i++) {
+        dst[i] = ap_trampoline_start[i];
+    }
+
+    uint64_t stack_slot = AP_TRAMPOLINE_ADDR + ((uint64_t)ap_stack_ptr - (uint64_t)ap_trampoline_start);
+    uint64_t entry_slot = AP_TRAMPOLINE_ADDR + ((uint64_t)ap_entry_ptr - (uint64_t)ap_trampoline_start);
+
+    // Bring the APs up one at a time - they all boot through the same
+    // trampoline page, so the stack slot is reused serially
+    for (int cpu = 1; cpu < num_cpus; cpu++) {
+        *(volatile uint64_t*)stack_slot = smp_kernel_stack_top(cpu);
+        *(volatile uint64_t*)entry_slot = (uint64_t)ap_main;
+
+        // INIT
+        lapic_write(LAPIC_ICR_HIGH, (uint32_t)cpu << 24);
+        lapic_write(LAPIC_ICR_LOW, 0x4500);
+        smp_delay(1000000);
+
+        // SIPI twice, pointing at the trampoline page
+        for (int i = 0; i < 2; i++) {
+            lapic_write(LAPIC_ICR_HIGH, (uint32_t)cpu << 24);
+            lapic_write(LAPIC_ICR_LOW, 0x4600 | (AP_TRAMPOLINE_ADDR >> 12));
+            smp_delay(200000);
+        }
+
+        smp_delay(1000000);
+    }
+
+    // Steal only from CPUs that actually came up: an AP that never
+    // reached ap_main has no queue worth scanning
+    cpu_count = cpus_online;
+}
@@ -0,0 +1,126 @@
+#include "kernel.h"
+
+// Kernel instrumentation: per-path latency histograms in rdtsc cycles.
+// Buckets are power-of-two: bucket i counts samples in [2^i, 2^(i+1)).
+kernel_stats_t kernel_stats;
+
+// Path names for stats_dump, indexed by STAT_PATH_*
+const char *stat_path_names[STAT_PATH_COUNT] = {
+    "syscall",
+    "schedule",
+    "send",
+    "recv",
+    "page_fault"
+};
+
+// Initialize instrumentation
+void stats_init(void) {
+    for (int i = 0; i < STAT_PATH_COUNT; i++) {
+        kernel_stats.count[i] = 0;
+        kernel_stats.total_cycles[i] = 0;
+        for (int j = 0; j < STAT_HISTOGRAM_BUCKETS; j++) {
+            kernel_stats.histogram[i][j] = 0;
+        }
+    }
+}
+
+// Record one sample of the given cycle count
+void stats_record_cycles(int path, uint64_t cycles) {
+    if (path < 0 || path >= STAT_PATH_COUNT) {
+        return;
+    }
+
+    kernel_stats.count[path]++;
+    kernel_stats.total_cycles[path] += cycles;
+
+    // Bucket index is floor(log2(cycles)), found with one bit-scan
+    uint64_t bucket = 0;
+    if (cycles != 0) {
+        __asm__("bsr %1, %0" : "=r"(bucket) : "r"(cycles));
+    }
+    if (bucket >= STAT_HISTOGRAM_BUCKETS) {
+        bucket = STAT_HISTOGRAM_BUCKETS - 1;
+    }
+    kernel_stats.histogram[path][bucket]++;
+}
+
+// Record one sample measured from the given start timestamp
+void stats_record(int path, uint64_t start_tsc) {
+    stats_record_cycles(path, read_tsc() - start_tsc);
+}
+
+// Copy the stats block out to a caller-supplied buffer
+int sys_get_stats(kernel_stats_t *buf) {
+    if (!buf) {
+        return -1;
+    }
+
+    kmemcpy(buf, &kernel_stats, sizeof(kernel_stats_t));
+
+    return 0;
+}
+
+// Copy per-task execution statistics out to user space, up to
+// max_tasks entries. Returns the number of entries filled, so callers
+// can see which task is eating the machine.
+int sys_task_stats(task_stats_t *buf, int max_tasks) {
+    if (!buf || max_tasks <= 0) {
+        return -1;
+    }
+
+    int filled = 0;
+    for (int i = 0; i < MAX_TASKS && filled < max_tasks; i++) {
+        if (tasks[i].state == TASK_ZOMBIE) {
+            continue;
+        }
+
+        buf[filled].pid = tasks[i].pid;
+        buf[filled].state = (int)tasks[i].state;
+        buf[filled].priority = tasks[i].priority;
+        buf[filled].runtime_cycles = tasks[i].runtime_cycles;
+        kstrncpy(buf[filled].name, tasks[i].name, sizeof(buf[filled].name));
+        filled++;
+    }
+
+    return filled;
+}
+
+// Print an unsigned number (kprintf has no format specifiers)
+void stats_print_number(uint64_t num) {
+    char buf[24];
+    int i = 0;
+
+    if (num == 0) {
+        buf[i++] = '0';
+    }
+    while (num > 0) {
+        buf[i++] = '0' + (num % 10);
+        num /= 10;
+    }
+
+    char out[24];
+    int j = 0;
+    while (i > 0) {
+        out[j++] = buf[--i];
+    }
+    out[j] = '\0';
+    kprintf(out);
+}
+
+// Dump per-path sample counts and average cycles to the console
+void stats_dump(void) {
+    kprintf("Kernel path statistics (cycles):\n");
+
+    for (int path = 0; path < STAT_PATH_COUNT; path++) {
+        kprintf(stat_path_names[path]);
+        kprintf(": count=");
+        stats_print_number(kernel_stats.count[path]);
+        kprintf(" avg=");
+        if (kernel_stats.count[path] > 0) {
+            stats_print_number(kernel_stats.total_cycles[path] / kernel_stats.count[path]);
+        } else {
+            stats_print_number(0);
+        }
+        kprintf("\n");
+    }
+}
@@ -10,16 +10,266 @@ typedef struct {
     bool dirty;
     bool accessed;
     uint64_t last_access;
+    int lru_prev; // More recently used frame (-1 = list head)
+    int lru_next; // Less recently used frame (-1 = list tail)
 } page_frame_t;
 
 page_frame_t page_frames[MAX_PHYSICAL_PAGES];
 int page_frame_count = 0;
 uint64_t next_physical_addr = 0x1000000; // Start after kernel
 
-// LRU list for page replacement
-int lru_list[MAX_PHYSICAL_PAGES];
-int lru_head = 0;
-int lru_tail = 0;
+// Physical frame free list: reclaimed frames are handed out again
+// before bumping next_physical_addr, so eviction no longer leaks
+uint64_t free_frames[MAX_PHYSICAL_PAGES];
+int free_frame_count = 0;
+
+// Allocate a physical frame, recycling freed frames first
+uint64_t alloc_frame(void) {
+    if (free_frame_count > 0) {
+        return free_frames[--free_frame_count];
+    }
+    uint64_t physical_addr = next_physical_addr;
+    next_physical_addr += PAGE_FRAME_SIZE;
+    return physical_addr;
+}
+
+// Return a physical frame to the free list
+void free_frame(uint64_t physical_addr) {
+    if (free_frame_count < MAX_PHYSICAL_PAGES) {
+        free_frames[free_frame_count++] = physical_addr;
+    }
+}
+
+// Allocate a run of contiguous 4KB frames for a multi-page kernel
+// object. Bypasses the free list, so these frames are never recycled.
+uint64_t alloc_frames(int count) {
+    uint64_t physical_addr = next_physical_addr;
+    next_physical_addr += (uint64_t)count * PAGE_FRAME_SIZE;
+    return physical_addr;
+}
+
+// Allocate a 2MB-aligned contiguous region for a huge-page mapping.
+// Huge frames bypass the 4KB free list and are never recycled.
+uint64_t alloc_frame_2mb(void) {
+    next_physical_addr = (next_physical_addr + HUGE_PAGE_SIZE - 1) & ~((uint64_t)HUGE_PAGE_SIZE - 1);
+    uint64_t physical_addr = next_physical_addr;
+    next_physical_addr += HUGE_PAGE_SIZE;
+    return physical_addr;
+}
+
+// Slab cache for page-table pages: alloc_frames keeps them page-
+// aligned, and freed tables recycle through a typed free list instead
+// of leaking into the general frame pool
+slab_cache_t pt_page_cache;
+
+// Allocate one page-table page
+uint64_t alloc_pt_page(void) {
+    return (uint64_t)slab_alloc(&pt_page_cache);
+}
+
+// Intrusive LRU list: head is most recently used, tail is the eviction victim
+int lru_head = -1;
+int lru_tail = -1;
+
+// Frame slots freed by eviction, reused before growing page_frame_count
+int free_slots[MAX_PHYSICAL_PAGES];
+int free_slot_count = 0;
+
+// Open-addressing hash table mapping virtual page number to frame index.
+// Twice MAX_PHYSICAL_PAGES entries keeps the load factor under 50%.
+#define FRAME_HASH_SIZE (MAX_PHYSICAL_PAGES * 2)
+#define FRAME_HASH_EMPTY -1
+#define FRAME_HASH_TOMBSTONE -2
+
+int frame_hash[FRAME_HASH_SIZE];
+
+// Hash a virtual address to a table slot
+int frame_hash_index(uint64_t virtual_addr) {
+    uint64_t vpn = virtual_addr >> 12;
+    return (int)((vpn * 0x9E3779B97F4A7C15) & (FRAME_HASH_SIZE - 1));
+}
+
+// Insert a virtual address -> frame index mapping
+void frame_hash_insert(uint64_t virtual_addr, int frame_index) {
+    int slot = frame_hash_index(virtual_addr);
+    for (int i = 0; i < FRAME_HASH_SIZE; i++) {
+        if (frame_hash[slot] == FRAME_HASH_EMPTY || frame_hash[slot] == FRAME_HASH_TOMBSTONE) {
+            frame_hash[slot] = frame_index;
+            return;
+        }
+        slot = (slot + 1) & (FRAME_HASH_SIZE - 1);
+    }
+}
+
+// Look up the frame index for a virtual address (-1 if not mapped)
+int frame_hash_lookup(uint64_t virtual_addr) {
+    int slot = frame_hash_index(virtual_addr);
+    for (int i = 0; i < FRAME_HASH_SIZE; i++) {
+        if (frame_hash[slot] == FRAME_HASH_EMPTY) {
+            return -1;
+        }
+        if (frame_hash[slot] != FRAME_HASH_TOMBSTONE &&
+            page_frames[frame_hash[slot]].virtual_addr == virtual_addr) {
+            return frame_hash[slot];
+        }
+        slot = (slot + 1) & (FRAME_HASH_SIZE - 1);
+    }
+    return -1;
+}
+
+// Remove the mapping for a virtual address
+void frame_hash_remove(uint64_t virtual_addr) {
+    int slot = frame_hash_index(virtual_addr);
+    for (int i = 0; i < FRAME_HASH_SIZE; i++) {
+        if (frame_hash[slot] == FRAME_HASH_EMPTY) {
+            return;
+        }
+        if (frame_hash[slot] != FRAME_HASH_TOMBSTONE &&
+            page_frames[frame_hash[slot]].virtual_addr == virtual_addr) {
+            frame_hash[slot] = FRAME_HASH_TOMBSTONE;
+            return;
+        }
+        slot = (slot + 1) & (FRAME_HASH_SIZE - 1);
+    }
+}
+
+// Unlink frame from the LRU list
+void lru_unlink(int index) {
+    page_frame_t *frame = &page_frames[index];
+
+    if (frame->lru_prev != -1) {
+        page_frames[frame->lru_prev].lru_next = frame->lru_next;
+    } else {
+        lru_head = frame->lru_next;
+    }
+
+    if (frame->lru_next != -1) {
+        page_frames[frame->lru_next].lru_prev = frame->lru_prev;
+    } else {
+        lru_tail = frame->lru_prev;
+    }
+
+    frame->lru_prev = -1;
+    frame->lru_next = -1;
+}
+
+// Push frame to the front (most recently used end) of the LRU list
+void lru_push_front(int index) {
+    page_frame_t *frame = &page_frames[index];
+
+    frame->lru_prev = -1;
+    frame->lru_next = lru_head;
+    if (lru_head != -1) {
+        page_frames[lru_head].lru_prev = index;
+    }
+    lru_head = index;
+    if (lru_tail == -1) {
+        lru_tail = index;
+    }
+}
+
+// Demand-paged ELF segments: the loader records each PT_LOAD extent
+// here instead of eagerly mapping it, and the page fault handler
+// populates faulting pages from the in-memory ELF image on first touch
+#define MAX_ELF_REGIONS 32
+
+typedef struct {
+    int pid;                  // Owning task (0 = slot free)
+    uint64_t vaddr;           // Segment start in the task's address space
+    uint64_t memsz;           // Total segment size (zero-filled past filesz)
+    uint64_t filesz;          // Bytes backed by the ELF image
+    const uint8_t *file_data; // Segment bytes inside the ELF image
+} elf_region_t;
+
+elf_region_t elf_regions[MAX_ELF_REGIONS];
+
+// Record a lazily loaded segment for a task
+int register_elf_region(int pid, uint64_t vaddr, uint64_t memsz, const uint8_t *file_data, uint64_t filesz) {
+    for (int i = 0; i < MAX_ELF_REGIONS; i++) {
+        if (elf_regions[i].pid == 0) {
+            elf_regions[i].pid = pid;
+            elf_regions[i].vaddr = vaddr;
+            elf_regions[i].memsz = memsz;
+            elf_regions[i].filesz = filesz;
+            elf_regions[i].file_data = file_data;
+            return 0;
+        }
+    }
+    return -1; // Region table full
+}
+
+// Drop all regions owned by an exiting task
+void clear_elf_regions(int pid) {
+    for (int i = 0; i < MAX_ELF_REGIONS; i++) {
+        if (elf_regions[i].pid == pid) {
+            elf_regions[i].pid = 0;
+        }
+    }
+}
+
+// First touch of a lazily loaded segment: map a fresh page and fill it
+// from the ELF image. Bytes past filesz (BSS) stay zero from the
+// allocator. Returns 1 if the fault was inside a registered region.
+int handle_elf_fault(uint64_t fault_addr) {
+    if (!current_task) {
+        return 0;
+    }
+
+    for (int i = 0; i < MAX_ELF_REGIONS; i++) {
+        elf_region_t *region = &elf_regions[i];
+        if (region->pid != current_task->pid ||
+            fault_addr < region->vaddr ||
+            fault_addr >= region->vaddr + region->memsz) {
+            continue;
+        }
+
+        // Huge-page promotion: if a whole 2MB-aligned window around
+        // the fault lies inside the region, fill it with one huge
+        // mapping — one fault and one TLB entry instead of 512
+        uint64_t huge_addr = fault_addr & ~(uint64_t)(HUGE_PAGE_SIZE - 1);
+        if (huge_addr >= region->vaddr &&
+            huge_addr + HUGE_PAGE_SIZE <= region->vaddr + region->memsz) {
+            uint64_t frame = alloc_frame_2mb();
+            kzero_nt((void*)frame, HUGE_PAGE_SIZE);
+
+            // Copy the file-backed bytes that land in this window
+            uint64_t seg_offset = huge_addr - region->vaddr;
+            if (seg_offset < region->filesz) {
+                uint64_t copy_len = HUGE_PAGE_SIZE;
+                if (seg_offset + copy_len > region->filesz) {
+                    copy_len = region->filesz - seg_offset;
+                }
+                kmemcpy((uint8_t*)frame, region->file_data + seg_offset, copy_len);
+            }
+
+            map_page_2mb(huge_addr, frame, true, true);
+            return 1;
+        }
+
+        uint64_t page_addr = fault_addr & ~(uint64_t)(PAGE_SIZE - 1);
+        if (allocate_page(page_addr) < 0) {
+            evict_lru_page();
+            allocate_page(page_addr);
+        }
+
+        // Copy the file-backed bytes that land on this page
+        uint64_t copy_vaddr = (page_addr > region->vaddr) ? page_addr : region->vaddr;
+        uint64_t seg_offset = copy_vaddr - region->vaddr;
+        if (seg_offset < region->filesz) {
+            uint64_t copy_len = page_addr + PAGE_SIZE - copy_vaddr;
+            if (seg_offset + copy_len > region->filesz) {
+                copy_len = region->filesz - seg_offset;
+            }
+
+            uint8_t *dst = (uint8_t*)get_physical_address(copy_vaddr);
+            kmemcpy(dst, region->file_data + seg_offset, copy_len);
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
 
 // Initialize virtual memory
 void vm_init(void) {
@@ -30,113 +280,133 @@ void vm_init(void) {
         page_frames[i].dirty = false;
         page_frames[i].accessed = false;
         page_frames[i].last_access = 0;
+        page_frames[i].lru_prev = -1;
+        page_frames[i].lru_next = -1;
     }
-    
-    // Initialize LRU list
-    for (int i = 0; i < MAX_PHYSICAL_PAGES; i++) {
-        lru_list[i] = i;
+
+    // Clear hash table
+    for (int i = 0; i < FRAME_HASH_SIZE; i++) {
+        frame_hash[i] = FRAME_HASH_EMPTY;
     }
-    lru_head = 0;
-    lru_tail = MAX_PHYSICAL_PAGES - 1;
-    
+
+    lru_head = -1;
+    lru_tail = -1;
+    free_slot_count = 0;
     page_frame_count = 0;
+
+    // Clear demand-paging region table
+    for (int i = 0; i < MAX_ELF_REGIONS; i++) {
+        elf_regions[i].pid = 0;
+    }
+
+    slab_cache_init(&pt_page_cache, "pt_page", PAGE_SIZE);
 }
 
 // Page fault handler
 void page_fault_handler_c(uint64_t fault_addr) {
+    uint64_t start_tsc = read_tsc();
+
     // Check if it's a valid user address
     if (fault_addr < USER_BASE || fault_addr >= USER_STACK_TOP) {
         panic("Page fault at invalid address");
     }
-    
+
+    // Write fault on a COW-shared page: copy the frame and retry
+    if (handle_cow_fault(fault_addr)) {
+        stats_record(STAT_PATH_PAGE_FAULT, start_tsc);
+        return;
+    }
+
+    // First touch of a lazily loaded ELF segment: fill from the image
+    if (handle_elf_fault(fault_addr)) {
+        stats_record(STAT_PATH_PAGE_FAULT, start_tsc);
+        return;
+    }
+
     // Try to allocate page
     if (allocate_page(fault_addr) < 0) {
         // No free pages, evict LRU page
         evict_lru_page();
         allocate_page(fault_addr);
     }
+
+    stats_record(STAT_PATH_PAGE_FAULT, start_tsc);
 }
 
 // Allocate page for virtual address
 int allocate_page(uint64_t virtual_addr) {
     // Check if page is already mapped
-    for (int i = 0; i < page_frame_count; i++) {
-        if (page_frames[i].virtual_addr == virtual_addr) {
-            // Update access time
-            page_frames[i].accessed = true;
-            page_frames[i].last_access = get_timestamp();
-            return 0;
-        }
+    int existing = frame_hash_lookup(virtual_addr);
+    if (existing != -1) {
+        // Update access time and move to front of the LRU list
+        page_frames[existing].accessed = true;
+        page_frames[existing].last_access = get_timestamp();
+        lru_unlink(existing);
+        lru_push_front(existing);
+        return 0;
     }
-    
-    // Check if we have free pages
-    if (page_frame_count >= MAX_PHYSICAL_PAGES) {
+
+    // Reuse an evicted slot if one is free, otherwise grow the array
+    int slot;
+    if (free_slot_count > 0) {
+        slot = free_slots[--free_slot_count];
+    } else if (page_frame_count < MAX_PHYSICAL_PAGES) {
+        slot = page_frame_count++;
+    } else {
         return -1; // No free pages
     }
-    
+
     // Allocate new page frame
-    uint64_t physical_addr = next_physical_addr;
-    next_physical_addr += PAGE_FRAME_SIZE;
-    
-    // Clear the page
-    for (int i = 0; i < PAGE_FRAME_SIZE / 8; i++) {
-        ((uint64_t*)physical_addr)[i] = 0;
-    }
-    
+    uint64_t physical_addr = alloc_frame();
+
+    // Clear the page with non-temporal stores - the new page is cold
+    // and zeroing it should not evict the faulting task's working set
+    kzero_nt((void*)physical_addr, PAGE_FRAME_SIZE);
+
     // Add to page frames
-    page_frames[page_frame_count].virtual_addr = virtual_addr;
-    page_frames[page_frame_count].physical_addr = physical_addr;
-    page_frames[page_frame_count].dirty = false;
-    page_frames[page_frame_count].accessed = true;
-    page_frames[page_frame_count].last_access = get_timestamp();
-    
+    page_frames[slot].virtual_addr = virtual_addr;
+    page_frames[slot].physical_addr = physical_addr;
+    page_frames[slot].dirty = false;
+    page_frames[slot].accessed = true;
+    page_frames[slot].last_access = get_timestamp();
+    lru_push_front(slot);
+    frame_hash_insert(virtual_addr, slot);
+
     // Map the page
     map_page(virtual_addr, physical_addr, true, true);
-    
-    page_frame_count++;
+
     return 0;
 }
 
-// Evict least recently used page
+// Evict least recently used page in O(1) by popping the LRU list tail
 void evict_lru_page(void) {
-    if (page_frame_count == 0) {
-        return;
-    }
-    
-    // Find least recently used page
-    int lru_index = -1;
-    uint64_t oldest_access = 0xFFFFFFFFFFFFFFFF;
-    
-    for (int i = 0; i < page_frame_count; i++) {
-        if (page_frames[i].last_access < oldest_access) {
-            oldest_access = page_frames[i].last_access;
-            lru_index = i;
-        }
-    }
-    
-    if (lru_index == -1) {
+    if (lru_tail == -1) {
         return;
     }
-    
+
+    int lru_index = lru_tail;
+
     // If page is dirty, write it back (simplified)
     if (page_frames[lru_index].dirty) {
         // In a real system, this would write to disk
         // For this prototype, we just mark it as clean
         page_frames[lru_index].dirty = false;
     }
-    
+
     // Unmap the page
     unmap_page(page_frames[lru_index].virtual_addr);
-    
-    // Remove from page frames
-    for (int i = lru_index; i < page_frame_count - 1; i++) {
-        page_frames[i] = page_frames[i + 1];
-    }
-    page_frame_count--;
+
+    // Return the physical frame and free the slot for reuse
+    free_frame(page_frames[lru_index].physical_addr);
+    lru_unlink(lru_index);
+    frame_hash_remove(page_frames[lru_index].virtual_addr);
+    page_frames[lru_index].virtual_addr = 0;
+    free_slots[free_slot_count++] = lru_index;
 }
 
-// Map virtual address to physical address
-void map_page(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool writable) {
+// Map virtual address to physical address without touching the TLB.
+// Callers mapping a run of pages use this in a loop and flush once.
+void map_page_noflush(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool writable) {
     // Calculate page table indices
     uint64_t pml4_index = (virtual_addr >> 39) & 0x1FF;
     uint64_t pdp_index = (virtual_addr >> 30) & 0x1FF;
@@ -150,9 +420,8 @@ void map_page(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool wri
     uint64_t *pml4 = (uint64_t*)pml4_base;
     if (!(pml4[pml4_index] & 1)) {
         // Allocate PDPT
-        uint64_t pdpt_addr = next_physical_addr;
-        next_physical_addr += 4096;
-        
+        uint64_t pdpt_addr = alloc_pt_page();
+
         // Clear PDPT
         for (int i = 0; i < 512; i++) {
             ((uint64_t*)pdpt_addr)[i] = 0;
@@ -167,9 +436,8 @@ void map_page(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool wri
     // Ensure PDP entry exists
     if (!(pdpt[pdp_index] & 1)) {
         // Allocate PD
-        uint64_t pd_addr = next_physical_addr;
-        next_physical_addr += 4096;
-        
+        uint64_t pd_addr = alloc_pt_page();
+
         // Clear PD
         for (int i = 0; i < 512; i++) {
             ((uint64_t*)pd_addr)[i] = 0;
@@ -188,9 +456,68 @@ void map_page(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool wri
     if (!user) flags |= 0x10; // Global
     
     pd[pd_index] = physical_addr | flags;
-    
-    // Reload page tables
-    write_cr3(read_cr3());
+}
+
+// Map a single page and invalidate just its TLB entry
+void map_page(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool writable) {
+    map_page_noflush(virtual_addr, physical_addr, user, writable);
+    invlpg_page(virtual_addr);
+}
+
+// Map a 2MB huge page. Huge mappings are not tracked in page_frames,
+// so they are never considered for LRU eviction.
+void map_page_2mb(uint64_t virtual_addr, uint64_t physical_addr, bool user, bool writable) {
+    // Calculate page table indices
+    uint64_t pml4_index = (virtual_addr >> 39) & 0x1FF;
+    uint64_t pdp_index = (virtual_addr >> 30) & 0x1FF;
+    uint64_t pd_index = (virtual_addr >> 21) & 0x1FF;
+
+    // Get page table base
+    uint64_t pml4_base = read_cr3();
+
+    // Ensure PML4 entry exists
+    uint64_t *pml4 = (uint64_t*)pml4_base;
+    if (!(pml4[pml4_index] & 1)) {
+        // Allocate PDPT
+        uint64_t pdpt_addr = alloc_pt_page();
+
+        // Clear PDPT
+        for (int i = 0; i < 512; i++) {
+            ((uint64_t*)pdpt_addr)[i] = 0;
+        }
+
+        pml4[pml4_index] = pdpt_addr | 3; // Present + Read/Write
+    }
+
+    // Get PDPT
+    uint64_t *pdpt = (uint64_t*)(pml4[pml4_index] & ~0xFFF);
+
+    // Ensure PDP entry exists
+    if (!(pdpt[pdp_index] & 1)) {
+        // Allocate PD
+        uint64_t pd_addr = alloc_pt_page();
+
+        // Clear PD
+        for (int i = 0; i < 512; i++) {
+            ((uint64_t*)pd_addr)[i] = 0;
+        }
+
+        pdpt[pdp_index] = pd_addr | 3; // Present + Read/Write
+    }
+
+    // Get PD
+    uint64_t *pd = (uint64_t*)(pdpt[pdp_index] & ~0xFFF);
+
+    // Set up huge-page entry
+    uint64_t flags = 1 | 0x80; // Present + 2MB
+    if (writable) flags |= 2; // Read/Write
+    if (user) flags |= 4; // User
+    if (!user) flags |= 0x10; // Global
+
+    pd[pd_index] = physical_addr | flags;
+
+    // Invalidate just this page's TLB entry
+    invlpg_page(virtual_addr);
 }
 
 // Unmap virtual address
@@ -215,9 +542,131 @@ void unmap_page(uint64_t virtual_addr) {
     
     uint64_t *pd = (uint64_t*)(pdpt[pdp_index] & ~0xFFF);
     pd[pd_index] = 0; // Clear entry
-    
-    // Reload page tables
-    write_cr3(read_cr3());
+
+    // Invalidate just this page's TLB entry
+    invlpg_page(virtual_addr);
+}
+
+// COW marker stored in the PTE "available" bits
+#define PTE_COW (1ULL << 9)
+
+// Build a fresh address space. The low identity-mapped region gets its
+// own PDPT/PD copy so user mappings can diverge per task; everything
+// else shares the boot tables.
+uint64_t create_address_space(void) {
+    uint64_t cr3 = clone_address_space(read_cr3());
+
+    // The boot tables identity-map the whole low gigabyte as present
+    // and writable, which would make every first touch in the user
+    // range silently hit whatever physical bytes sit there instead of
+    // faulting. Clear those entries so demand paging, COW and the ELF
+    // loader actually see the faults they rely on. fork keeps its
+    // parent's entries: it goes through clone_address_space directly.
+    uint64_t *pml4 = (uint64_t*)cr3;
+    uint64_t *pdpt = (uint64_t*)(pml4[0] & ~0xFFF);
+    uint64_t *pd = (uint64_t*)(pdpt[0] & ~0xFFF);
+    for (uint64_t addr = USER_BASE; addr < USER_STACK_TOP; addr += HUGE_PAGE_SIZE) {
+        pd[(addr >> 21) & 0x1FF] = 0;
+    }
+
+    return cr3;
+}
+
+// Duplicate an address space at the PD level. Used by create_task (to
+// copy the kernel's boot tables) and by fork_task, where the caller
+// then marks the user range copy-on-write.
+uint64_t clone_address_space(uint64_t parent_cr3) {
+    uint64_t *parent_pml4 = (uint64_t*)parent_cr3;
+
+    uint64_t pml4_addr = alloc_pt_page();
+    uint64_t *pml4 = (uint64_t*)pml4_addr;
+
+    // Share all top-level entries with the parent
+    for (int i = 0; i < 512; i++) {
+        pml4[i] = parent_pml4[i];
+    }
+
+    // Copy the low chain (identity map + user region) so this address
+    // space can remap user pages without touching the parent's tables
+    if (parent_pml4[0] & 1) {
+        uint64_t *parent_pdpt = (uint64_t*)(parent_pml4[0] & ~0xFFF);
+        uint64_t pdpt_addr = alloc_pt_page();
+        uint64_t *pdpt = (uint64_t*)pdpt_addr;
+
+        for (int i = 0; i < 512; i++) {
+            pdpt[i] = parent_pdpt[i];
+        }
+
+        if (parent_pdpt[0] & 1) {
+            uint64_t *parent_pd = (uint64_t*)(parent_pdpt[0] & ~0xFFF);
+            uint64_t pd_addr = alloc_pt_page();
+            uint64_t *pd = (uint64_t*)pd_addr;
+
+            for (int i = 0; i < 512; i++) {
+                pd[i] = parent_pd[i];
+            }
+
+            pdpt[0] = pd_addr | 7; // Present + Read/Write + User
+        }
+
+        pml4[0] = pdpt_addr | 7; // Present + Read/Write + User
+    }
+
+    return pml4_addr;
+}
+
+// Share the user range of parent and child copy-on-write: writable
+// entries in both tables become read-only with the COW bit set, so the
+// first write in either address space faults and copies the frame.
+void mark_cow_range(uint64_t parent_cr3, uint64_t child_cr3) {
+    uint64_t *parent_pml4 = (uint64_t*)parent_cr3;
+    uint64_t *child_pml4 = (uint64_t*)child_cr3;
+
+    uint64_t *parent_pd = (uint64_t*)(((uint64_t*)(parent_pml4[0] & ~0xFFF))[0] & ~0xFFF);
+    uint64_t *child_pd = (uint64_t*)(((uint64_t*)(child_pml4[0] & ~0xFFF))[0] & ~0xFFF);
+
+    for (uint64_t addr = USER_BASE; addr < USER_STACK_TOP; addr += 0x200000) {
+        uint64_t pd_index = (addr >> 21) & 0x1FF;
+
+        if ((parent_pd[pd_index] & 1) && (parent_pd[pd_index] & 2)) {
+            parent_pd[pd_index] = (parent_pd[pd_index] & ~2ULL) | PTE_COW;
+            child_pd[pd_index] = parent_pd[pd_index];
+            invlpg_page(addr);
+        }
+    }
+}
+
+// Resolve a write fault on a COW-shared page by copying the frame into
+// the faulting task's address space. Returns 1 if the fault was COW.
+int handle_cow_fault(uint64_t fault_addr) {
+    uint64_t pml4_index = (fault_addr >> 39) & 0x1FF;
+    uint64_t pdp_index = (fault_addr >> 30) & 0x1FF;
+    uint64_t pd_index = (fault_addr >> 21) & 0x1FF;
+
+    uint64_t *pml4 = (uint64_t*)read_cr3();
+    if (!(pml4[pml4_index] & 1)) {
+        return 0;
+    }
+
+    uint64_t *pdpt = (uint64_t*)(pml4[pml4_index] & ~0xFFF);
+    if (!(pdpt[pdp_index] & 1)) {
+        return 0;
+    }
+
+    uint64_t *pd = (uint64_t*)(pdpt[pdp_index] & ~0xFFF);
+    uint64_t entry = pd[pd_index];
+    if (!(entry & 1) || !(entry & PTE_COW)) {
+        return 0;
+    }
+
+    // Copy the shared frame and remap it writable, COW bit cleared
+    uint64_t old_physical = entry & ~0xFFFULL;
+    uint64_t new_physical = alloc_frame();
+    kmemcpy((void*)new_physical, (void*)old_physical, PAGE_FRAME_SIZE);
+
+    pd[pd_index] = new_physical | ((entry & 0xFFF) & ~PTE_COW) | 2;
+    invlpg_page(fault_addr);
+    return 1;
 }
 
 // Get physical address for virtual address
@@ -257,11 +706,9 @@ uint64_t get_timestamp(void) {
 
 // Mark page as dirty
 void mark_page_dirty(uint64_t virtual_addr) {
-    for (int i = 0; i < page_frame_count; i++) {
-        if (page_frames[i].virtual_addr == virtual_addr) {
-            page_frames[i].dirty = true;
-            break;
-        }
+    int index = frame_hash_lookup(virtual_addr);
+    if (index != -1) {
+        page_frames[index].dirty = true;
     }
 }
 
@@ -278,7 +725,7 @@ vm_stats_t vm_stats = {0, 0, 0, 0, 0};
 
 vm_stats_t get_vm_stats(void) {
     vm_stats.total_pages = MAX_PHYSICAL_PAGES;
-    vm_stats.used_pages = page_frame_count;
-    vm_stats.free_pages = MAX_PHYSICAL_PAGES - page_frame_count;
+    vm_stats.used_pages = page_frame_count - free_slot_count;
+    vm_stats.free_pages = MAX_PHYSICAL_PAGES - vm_stats.used_pages;
     return vm_stats;
 } 
\ No newline at end of file
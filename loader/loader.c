@@ -37,91 +37,141 @@ typedef struct {
 #define PF_W 2
 #define PF_X 1
 
-// Load ELF file into memory
+// The initrd image, handed to kernel_main by the bootloader. It must
+// stay resident for the life of the system: read-only segments are
+// mapped straight onto its frames and demand-paged regions read from
+// it long after loading.
+const uint8_t *initrd_base = NULL;
+const initrd_header_t *initrd_header = NULL;
+
+// Record and validate the initrd image the bootloader loaded
+void initrd_init(uint64_t addr) {
+    const initrd_header_t *header = (const initrd_header_t*)addr;
+    if (header->magic != INITRD_MAGIC || header->count > INITRD_MAX_MEMBERS) {
+        return; // No (or corrupt) initrd; loads will fail cleanly
+    }
+
+    initrd_base = (const uint8_t*)addr;
+    initrd_header = header;
+}
+
+// Look a member up by name, returning its bytes and size
+const uint8_t *initrd_find(const char *name, size_t *size) {
+    if (!initrd_header) {
+        return NULL;
+    }
+
+    const initrd_member_t *members =
+        (const initrd_member_t*)(initrd_base + sizeof(initrd_header_t));
+    for (uint32_t i = 0; i < initrd_header->count; i++) {
+        // Compare names (no strcmp in the kernel)
+        const char *a = members[i].name;
+        const char *b = name;
+        while (*a && *a == *b) {
+            a++;
+            b++;
+        }
+        if (*a == *b) {
+            if (size) {
+                *size = members[i].size;
+            }
+            return initrd_base + members[i].offset;
+        }
+    }
+
+    return NULL;
+}
+
+// Load an ELF binary from the initrd into a task
 int load_elf(const char *path, pcb_t *task) {
-    // For this prototype, we'll create a simple user program
-    // In a real system, this would parse the ELF file from disk
-    
-    // Set up user program at the specified entry point
-    uint64_t entry_point = task->rip;
-    
-    // Create a simple "Hello World" program
-    uint8_t *user_code = (uint8_t*)entry_point;
-    
-    // Simple assembly code for user program
-    // This is a minimal program that prints "Hello World" and exits
-    uint8_t hello_world_code[] = {
-        0x48, 0x31, 0xc0,                   // xor rax, rax
-        0x48, 0x31, 0xdb,                   // xor rbx, rbx
-        0x48, 0x31, 0xc9,                   // xor rcx, rcx
-        0x48, 0x31, 0xd2,                   // xor rdx, rdx
-        0x48, 0x31, 0xf6,                   // xor rsi, rsi
-        0x48, 0x31, 0xff,                   // xor rdi, rdi
-        0x48, 0x31, 0xed,                   // xor rbp, rbp
-        0x48, 0x31, 0xc0,                   // xor rax, rax
-        0xcd, 0x80,                         // int 0x80 (syscall)
-        0xeb, 0xfe                          // jmp $ (infinite loop)
-    };
-    
-    // Copy code to user space
-    for (int i = 0; i < sizeof(hello_world_code); i++) {
-        user_code[i] = hello_world_code[i];
+    size_t size;
+    const uint8_t *image = initrd_find(path, &size);
+    if (!image) {
+        return -1;
     }
-    
+
+    int entry = load_elf_from_memory(image, 0, task->pid);
+    if (entry < 0) {
+        return -1;
+    }
+
     // Set up user stack
-    uint64_t stack_top = entry_point - USER_STACK_SIZE;
-    task->rsp = stack_top + USER_STACK_SIZE - 16;
-    
+    task->rsp = task->stack_base + task->stack_size - 16;
+
     // Set up initial registers
-    task->rip = entry_point;
+    task->rip = entry;
     task->rflags = 0x202; // Interrupts enabled, IOPL=0
-    
+
     return 0;
 }
 
-// Load user program from initrd
-int load_user_program(const char *name, uint64_t entry_point) {
-    // Create task for the program
-    pcb_t *task = NULL;
+// Load a user program from the initrd into a fresh task. The ELF
+// decides the entry point; the stack sits just below stack_top. The
+// task gets its own address space, and the loader switches into it
+// while mapping segments and seeding the stack so everything lands in
+// the task's tables rather than the caller's.
+int load_user_program(const char *name, uint64_t stack_top) {
+    // Find free task slot
+    int task_id = -1;
     for (int i = 0; i < MAX_TASKS; i++) {
         if (tasks[i].state == TASK_ZOMBIE) {
-            task = &tasks[i];
+            task_id = i;
             break;
         }
     }
-    
-    if (!task) {
+
+    if (task_id == -1) {
         return -1; // No free task slots
     }
-    
+
     // Initialize task
+    pcb_t *task = &tasks[task_id];
     task->pid = next_pid++;
     task->state = TASK_READY;
     task->priority = 1;
-    task->stack_base = entry_point - USER_STACK_SIZE;
+    task->base_priority = 1;
+    task->wait_state = WAIT_NONE;
+    task->wait_next = NULL;
+    task->ipc_partner = -1;
+    task->runtime_cycles = 0;
+    task->recv_spin_cycles = RECV_SPIN_MIN;
+    task->fpu_used = 0;
+    task->ipc_queue = NULL;
+    task->stack_base = stack_top - USER_STACK_SIZE;
     task->stack_size = USER_STACK_SIZE;
-    task->rip = entry_point;
-    task->rsp = entry_point;
-    task->rflags = 0x202;
-    task->cr3 = read_cr3();
-    
+    task->cr3 = create_address_space(); // Per-task page tables
+
     // Copy program name
-    int name_len = 0;
-    while (name[name_len] && name_len < 31) {
-        task->name[name_len] = name[name_len];
-        name_len++;
-    }
-    task->name[name_len] = '\0';
-    
-    // Load the program
+    kstrncpy(task->name, name, sizeof(task->name));
+
+    // Map and register segments inside the task's own address space
+    uint64_t caller_cr3 = read_cr3();
+    write_cr3(task->cr3);
+
     if (load_elf(name, task) < 0) {
+        write_cr3(caller_cr3);
         task->state = TASK_ZOMBIE;
         return -1;
     }
-    
-    // Add to ready queue
+
+    // Set up the initial stack frame like create_task does; the stack
+    // pages demand-allocate into the task's tables as we write them
+    uint64_t *stack = (uint64_t*)task->rsp;
+    stack[-1] = task->rip;   // Return address
+    stack[-2] = 0x202;       // RFLAGS
+    stack[-3] = 0x23;        // CS (user code segment, RPL 3)
+    stack[-4] = 0x1B;        // SS (user data segment, RPL 3)
+    for (int i = 5; i <= 19; i++) {
+        stack[-i] = 0;       // General-purpose registers
+    }
+    task->rsp = (uint64_t)&stack[-19];
+
+    write_cr3(caller_cr3);
+
+    // Register in the PID lookup table and add to ready queue
+    pid_hash_insert(task->pid, task_id);
     enqueue_ready(task);
-    
+
     return task->pid;
 }
 
@@ -133,9 +183,7 @@ int parse_elf_header(const uint8_t *data, elf64_header_t *header) {
     }
     
     // Copy header
-    for (int i = 0; i < sizeof(elf64_header_t); i++) {
-        ((uint8_t*)header)[i] = data[i];
-    }
+    kmemcpy(header, data, sizeof(elf64_header_t));
     
     // Check if it's a 64-bit ELF
     if (header->e_ident[4] != 2) { // ELFCLASS64
@@ -150,59 +198,65 @@ int parse_elf_header(const uint8_t *data, elf64_header_t *header) {
     return 0;
 }
 
-// Load ELF segment
-int load_elf_segment(const uint8_t *data, const elf64_phdr_t *phdr, uint64_t base_addr) {
+// Load one ELF segment. Read-only segments that sit page-aligned in
+// the image (the initrd pads members to page boundaries, and linkers
+// align PT_LOAD segments) are mapped zero-copy straight onto the
+// image's frames: task startup then costs page-table writes, not byte
+// copies of the binary. Writable segments keep the lazy demand-paged
+// copy, since tasks must not scribble on the shared image.
+int load_elf_segment(const uint8_t *data, const elf64_phdr_t *phdr, uint64_t base_addr, int pid) {
     // Check if this is a loadable segment
     if (phdr->p_type != PT_LOAD) {
         return 0;
     }
-    
+
     // Calculate virtual address
     uint64_t vaddr = base_addr + phdr->p_vaddr;
-    
-    // Map the segment
-    for (uint64_t offset = 0; offset < phdr->p_memsz; offset += 4096) {
-        uint64_t page_addr = vaddr + offset;
-        uint64_t physical_addr = next_physical_addr;
-        next_physical_addr += 4096;
-        
-        // Map the page
-        map_page(page_addr, physical_addr, true, true);
-        
-        // Copy data if available
-        if (offset < phdr->p_filesz) {
-            uint64_t copy_size = 4096;
-            if (offset + copy_size > phdr->p_filesz) {
-                copy_size = phdr->p_filesz - offset;
-            }
-            
-            for (uint64_t i = 0; i < copy_size; i++) {
-                ((uint8_t*)physical_addr)[i] = data[phdr->p_offset + offset + i];
-            }
+
+    uint64_t file_start = (uint64_t)(data + phdr->p_offset);
+    if (!(phdr->p_flags & PF_W) &&
+        (file_start & (PAGE_SIZE - 1)) == 0 &&
+        (vaddr & (PAGE_SIZE - 1)) == 0) {
+        // Zero-copy: point the page tables at the initrd's own frames
+        // (physical == virtual for kernel data in this prototype)
+        for (uint64_t off = 0; off < phdr->p_filesz; off += PAGE_SIZE) {
+            map_page(vaddr + off, file_start + off, true, false);
         }
+
+        // Any zero-fill tail past the file bytes still demand-faults
+        uint64_t file_end = vaddr + phdr->p_filesz;
+        uint64_t tail = (file_end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+        if (vaddr + phdr->p_memsz > tail) {
+            return register_elf_region(pid, tail, vaddr + phdr->p_memsz - tail,
+                                       NULL, 0);
+        }
+        return 0;
     }
-    
-    return 0;
+
+    // Register the extent; the image must stay resident since faults
+    // read from it long after the loader returns
+    return register_elf_region(pid, vaddr, phdr->p_memsz,
+                               data + phdr->p_offset, phdr->p_filesz);
 }
 
 // Load ELF file from memory
-int load_elf_from_memory(const uint8_t *data, uint64_t base_addr) {
+int load_elf_from_memory(const uint8_t *data, uint64_t base_addr, int pid) {
     elf64_header_t header;
-    
+
     // Parse ELF header
     if (parse_elf_header(data, &header) < 0) {
         return -1;
     }
-    
-    // Load program segments
+
+    // Register program segments for demand paging
     for (int i = 0; i < header.e_phnum; i++) {
         const elf64_phdr_t *phdr = (const elf64_phdr_t*)(data + header.e_phoff + i * header.e_phentsize);
-        
-        if (load_elf_segment(data, phdr, base_addr) < 0) {
+
+        if (load_elf_segment(data, phdr, base_addr, pid) < 0) {
             return -1;
         }
     }
-    
+
     return header.e_entry;
 }
 
@@ -226,9 +280,7 @@ int create_simple_user_task(const char *name, uint64_t entry_point) {
     };
     
     // Copy program to user space
-    for (int i = 0; i < sizeof(simple_program); i++) {
-        user_code[i] = simple_program[i];
-    }
+    kmemcpy(user_code, simple_program, sizeof(simple_program));
     
     // Create task
     return create_task(name, entry_point, 1);
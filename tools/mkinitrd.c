@@ -0,0 +1,115 @@
+// Host-side initrd builder: packs user binaries into the simple
+// archive the kernel loader understands (see initrd_header_t in
+// kernel/include/kernel.h). Member data is padded to page boundaries
+// so the kernel can map read-only ELF segments straight from the
+// image without copying.
+//
+// Usage: mkinitrd <output.img> <member>...
+// Missing input files are skipped with a warning so optional test
+// programs do not break the build.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITRD_MAGIC 0x64726E69 // "inrd" — must match kernel.h
+#define INITRD_MAX_MEMBERS 16
+#define PAGE_SIZE 4096
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+} initrd_header_t;
+
+typedef struct {
+    char name[32];
+    uint64_t offset;
+    uint64_t size;
+} initrd_member_t;
+
+// Strip any directory prefix so members are found by basename
+static const char *basename_of(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <output.img> <member>...\n", argv[0]);
+        return 1;
+    }
+
+    initrd_header_t header = { INITRD_MAGIC, 0 };
+    initrd_member_t members[INITRD_MAX_MEMBERS];
+    uint8_t *blobs[INITRD_MAX_MEMBERS];
+    memset(members, 0, sizeof(members));
+
+    // Data starts page-aligned after the header and member table
+    uint64_t offset = sizeof(header) + sizeof(members);
+    offset = (offset + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+
+    for (int i = 2; i < argc; i++) {
+        if (header.count >= INITRD_MAX_MEMBERS) {
+            fprintf(stderr, "mkinitrd: too many members, dropping %s\n", argv[i]);
+            break;
+        }
+
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "mkinitrd: skipping missing %s\n", argv[i]);
+            continue;
+        }
+
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+
+        uint8_t *blob = malloc(size);
+        if (fread(blob, 1, size, f) != (size_t)size) {
+            fprintf(stderr, "mkinitrd: short read on %s\n", argv[i]);
+            fclose(f);
+            return 1;
+        }
+        fclose(f);
+
+        initrd_member_t *m = &members[header.count];
+        snprintf(m->name, sizeof(m->name), "%s", basename_of(argv[i]));
+        m->offset = offset;
+        m->size = size;
+        blobs[header.count] = blob;
+        header.count++;
+
+        offset += ((uint64_t)size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    }
+
+    FILE *out = fopen(argv[1], "wb");
+    if (!out) {
+        fprintf(stderr, "mkinitrd: cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(members, sizeof(members), 1, out);
+
+    // Pad to each member's page-aligned offset, then write its bytes
+    for (uint32_t i = 0; i < header.count; i++) {
+        long pos = ftell(out);
+        for (; (uint64_t)pos < members[i].offset; pos++) {
+            fputc(0, out);
+        }
+        fwrite(blobs[i], 1, members[i].size, out);
+        free(blobs[i]);
+    }
+
+    // Pad the image itself to a page boundary
+    long pos = ftell(out);
+    while (pos & (PAGE_SIZE - 1)) {
+        fputc(0, out);
+        pos++;
+    }
+
+    fclose(out);
+    printf("mkinitrd: %s (%u members, %ld bytes)\n", argv[1], header.count, pos);
+    return 0;
+}
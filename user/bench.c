@@ -0,0 +1,181 @@
+// Microbenchmark suite for the microkernel
+// Hammers the hot kernel paths - IPC ping-pong, yield loops, and page
+// fault storms - and prints cycles per operation measured with rdtsc.
+// Built into the bench image by `make bench`.
+
+// Fixed-width types spelled out here: user programs build with
+// -nostdinc, so even the compiler's stdint.h is out of reach
+typedef unsigned short uint16_t;
+typedef unsigned int uint32_t;
+typedef unsigned long uint64_t;
+typedef long int64_t;
+
+// System call numbers
+#define SYS_SEND 1
+#define SYS_RECV 2
+#define SYS_YIELD 3
+#define SYS_EXIT 4
+
+// Iterations per benchmark: enough to amortize the timer reads.
+// The fault storm walks up from 0x500000 and must stop short of the
+// 16KB stack at the top of the user range, or the last touches land on
+// already-mapped stack pages and measure nothing.
+#define BENCH_IPC_ROUNDS 10000
+#define BENCH_YIELD_ROUNDS 10000
+#define BENCH_FAULT_PAGES 240
+
+// Pong runs as the second created task
+#define PONG_PID 2
+
+// System call wrapper using the SYSCALL fast path (rcx/r11 are
+// clobbered by the instruction itself; int 0x80 remains for compat)
+static inline int64_t syscall(int64_t number, int64_t arg1, int64_t arg2, int64_t arg3) {
+    int64_t result;
+    __asm__ volatile(
+        "syscall"
+        : "=a" (result)
+        : "a" (number), "D" (arg1), "S" (arg2), "d" (arg3)
+        : "rcx", "r11", "memory"
+    );
+    return result;
+}
+
+// Read the time stamp counter
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Simple print function (writes to video memory)
+void print_string(const char *str) {
+    volatile uint16_t *video = (volatile uint16_t*)0xB8000;
+    static int x = 0, y = 0;
+
+    while (*str) {
+        if (*str == '\n') {
+            x = 0;
+            y++;
+            if (y >= 25) y = 0;
+        } else {
+            video[y * 80 + x] = 0x0F00 | *str; // White on black
+            x++;
+            if (x >= 80) {
+                x = 0;
+                y++;
+                if (y >= 25) y = 0;
+            }
+        }
+        str++;
+    }
+}
+
+// Print an unsigned 64-bit number
+void print_number(uint64_t num) {
+    char buf[32];
+    int i = 0;
+
+    if (num == 0) {
+        buf[i++] = '0';
+    } else {
+        while (num > 0) {
+            buf[i++] = '0' + (num % 10);
+            num /= 10;
+        }
+    }
+
+    // Reverse the string
+    for (int j = 0; j < i / 2; j++) {
+        char temp = buf[j];
+        buf[j] = buf[i - 1 - j];
+        buf[i - 1 - j] = temp;
+    }
+    buf[i] = '\0';
+
+    print_string(buf);
+}
+
+// Print one result line: "<name>: <cycles> cycles/op"
+void print_result(const char *name, uint64_t total_cycles, uint64_t ops) {
+    print_string(name);
+    print_string(": ");
+    print_number(total_cycles / ops);
+    print_string(" cycles/op\n");
+}
+
+// IPC round-trip: send to pong and wait for the echo, so one round
+// covers two sends, two receives and at least two context switches
+void bench_ipc(void) {
+    char msg[64];
+    char reply[64];
+
+    for (int i = 0; i < 64; i++) {
+        msg[i] = 'a';
+    }
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_IPC_ROUNDS; i++) {
+        syscall(SYS_SEND, PONG_PID, (int64_t)msg, sizeof(msg));
+        syscall(SYS_RECV, (int64_t)reply, sizeof(reply), 0);
+    }
+    uint64_t total = rdtsc() - start;
+
+    print_result("ipc_round_trip", total, BENCH_IPC_ROUNDS);
+}
+
+// Yield in a tight loop; with pong also yielding, each iteration is
+// one trip through schedule() and a context switch
+void bench_yield(void) {
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_YIELD_ROUNDS; i++) {
+        syscall(SYS_YIELD, 0, 0, 0);
+    }
+    uint64_t total = rdtsc() - start;
+
+    print_result("yield", total, BENCH_YIELD_ROUNDS);
+}
+
+// Touch a run of unmapped pages so every store takes the full
+// page_fault_handler_c path: fault, allocate, zero, map
+void bench_fault(void) {
+    volatile char *region = (volatile char*)0x500000;
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_FAULT_PAGES; i++) {
+        region[i * 4096] = 'X';
+    }
+    uint64_t total = rdtsc() - start;
+
+    print_result("page_fault", total, BENCH_FAULT_PAGES);
+}
+
+// Ping side: drives all three benchmarks, then exits
+void _start(void) {
+    print_string("Benchmark suite starting\n");
+
+    bench_ipc();
+    bench_yield();
+    bench_fault();
+
+    print_string("Benchmark suite done\n");
+    syscall(SYS_EXIT, 0, 0, 0);
+
+    // Should never reach here
+    while (1) {
+        __asm__("hlt");
+    }
+}
+
+// Pong side: echo every message back, yield in between so the yield
+// benchmark has a partner to switch with
+void bench_pong(void) {
+    char buf[64];
+
+    while (1) {
+        int64_t size = syscall(SYS_RECV, (int64_t)buf, sizeof(buf), 0);
+        if (size > 0) {
+            syscall(SYS_SEND, 1, (int64_t)buf, size);
+        }
+        syscall(SYS_YIELD, 0, 0, 0);
+    }
+}
@@ -1,15 +1,20 @@
 // Simple user program for microkernel OS
 // This program demonstrates basic user space functionality
 
-#include <stdint.h>
+// Fixed-width types spelled out here: user programs build with
+// -nostdinc, so even the compiler's stdint.h is out of reach
+typedef unsigned short uint16_t;
+typedef long int64_t;
 
 // System call numbers
 #define SYS_SEND 1
 #define SYS_RECV 2
 #define SYS_YIELD 3
 #define SYS_EXIT 4
+#define SYS_SLEEP 9
 
-// Simple system call wrapper
+// System call wrapper using the SYSCALL fast path (rcx/r11 are
+// clobbered by the instruction itself; int 0x80 remains for compat)
 static inline int64_t syscall(int64_t number, int64_t arg1, int64_t arg2, int64_t arg3) {
     int64_t result;
     __asm__ volatile(
@@ -89,8 +94,9 @@ void _start(void) {
         print_number(i);
         print_string("\n");
         
-        // Yield to other tasks
-        syscall(SYS_YIELD, 0, 0, 0);
+        // Sleep between iterations instead of spinning on yield; the
+        // timer wheel wakes us when the deadline passes
+        syscall(SYS_SLEEP, 100, 0, 0);
     }
     
     // Exit